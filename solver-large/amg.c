@@ -0,0 +1,671 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defines.h"
+#include "amg.h"
+
+/* relative norm of the nullspace vector dropped in the aggregate */
+#define AMG_DROP_TOLERANCE 1e-10
+/* number of power iterations estimating spectral radius of D^-1 A */
+#define AMG_POWER_ITERATIONS 20
+
+
+/*************************************************************/
+/* Sparse matrices operations                                */
+
+static void amg_matrix_init(amg_matrix_ptr A, int rows, int cols, int nnz)
+{
+  A->rows_count = rows;
+  A->cols_count = cols;
+  A->offsets = (int*)calloc(rows + 1,sizeof(int));
+  A->indexes = (int*)malloc(sizeof(int)*(nnz > 0 ? nnz : 1));
+  A->values = (real*)malloc(sizeof(real)*(nnz > 0 ? nnz : 1));
+}
+
+static void amg_matrix_free(amg_matrix_ptr A)
+{
+  free(A->offsets);
+  free(A->indexes);
+  free(A->values);
+  memset(A,0,sizeof(amg_matrix));
+}
+
+void amg_matrix_mv(amg_matrix_ptr A, real* x, real* y)
+{
+  int i,j;
+  real sum;
+  for (i = 0; i < A->rows_count; ++ i)
+  {
+    sum = 0;
+    for (j = A->offsets[i]; j < A->offsets[i+1]; ++ j)
+      sum += A->values[j]*x[A->indexes[j]];
+    y[i] = sum;
+  }
+}
+
+/* T = A^T */
+static void amg_matrix_transpose(amg_matrix_ptr A, amg_matrix_ptr T)
+{
+  int i,j,k;
+  amg_matrix_init(T,A->cols_count,A->rows_count,A->offsets[A->rows_count]);
+  for (j = 0; j < A->offsets[A->rows_count]; ++ j)
+    T->offsets[A->indexes[j]+1] ++;
+  for (i = 0; i < T->rows_count; ++ i)
+    T->offsets[i+1] += T->offsets[i];
+  for (i = 0; i < A->rows_count; ++ i)
+    for (j = A->offsets[i]; j < A->offsets[i+1]; ++ j)
+    {
+      k = T->offsets[A->indexes[j]]++;
+      T->indexes[k] = i;
+      T->values[k] = A->values[j];
+    }
+  for (i = T->rows_count; i > 0; -- i)
+    T->offsets[i] = T->offsets[i-1];
+  T->offsets[0] = 0;
+}
+
+/* C = A*B using dense accumulator per row */
+static void amg_matrix_mul(amg_matrix_ptr A, amg_matrix_ptr B,
+                           amg_matrix_ptr C)
+{
+  int i,j,k,col,start;
+  int capacity = A->offsets[A->rows_count] + B->offsets[B->rows_count];
+  int* position = (int*)malloc(sizeof(int)*(B->cols_count > 0 ?
+                                            B->cols_count : 1));
+  int nnz = 0;
+  real value;
+  amg_matrix_init(C,A->rows_count,B->cols_count,capacity);
+  for (i = 0; i < B->cols_count; ++ i)
+    position[i] = -1;
+  for (i = 0; i < A->rows_count; ++ i)
+  {
+    start = nnz;
+    for (j = A->offsets[i]; j < A->offsets[i+1]; ++ j)
+    {
+      value = A->values[j];
+      for (k = B->offsets[A->indexes[j]]; k < B->offsets[A->indexes[j]+1];
+           ++ k)
+      {
+        col = B->indexes[k];
+        if (position[col] < start)
+        {
+          if (nnz == capacity)
+          {
+            capacity *= 2;
+            C->indexes = (int*)realloc(C->indexes,sizeof(int)*capacity);
+            C->values = (real*)realloc(C->values,sizeof(real)*capacity);
+          }
+          position[col] = nnz;
+          C->indexes[nnz] = col;
+          C->values[nnz++] = value*B->values[k];
+        }
+        else
+          C->values[position[col]] += value*B->values[k];
+      }
+    }
+    C->offsets[i+1] = nnz;
+  }
+  free(position);
+}
+
+/* Extract the diagonal of the matrix */
+static real* amg_matrix_diag(amg_matrix_ptr A)
+{
+  int i,j;
+  real* diag = (real*)calloc(A->rows_count > 0 ? A->rows_count : 1,
+                             sizeof(real));
+  for (i = 0; i < A->rows_count; ++ i)
+    for (j = A->offsets[i]; j < A->offsets[i+1]; ++ j)
+      if (A->indexes[j] == i)
+        diag[i] += A->values[j];
+  return diag;
+}
+
+
+/*************************************************************/
+/* Setup of the hierarchy                                    */
+
+/*
+ * Aggregation of nodes by the strength of connections
+ * dof_node - node of every equation
+ * agg - output aggregate of every node, -1 for nodes without equations
+ * Returns the number of aggregates
+ */
+static int amg_aggregate(amg_matrix_ptr A, real strength,
+                         int nodes_count, int* node_offsets, int* dof_node,
+                         int* agg)
+{
+  real* norms = (real*)calloc(nodes_count,sizeof(real));
+  real* acc = (real*)calloc(nodes_count,sizeof(real));
+  int* mark = (int*)malloc(sizeof(int)*nodes_count);
+  int* list = (int*)malloc(sizeof(int)*nodes_count);
+  int* xadj = (int*)malloc(sizeof(int)*(nodes_count+1));
+  int capacity = nodes_count*8 + 1;
+  int* adj = (int*)malloc(sizeof(int)*capacity);
+  real* weight = (real*)malloc(sizeof(real)*capacity);
+  int* pass1 = (int*)malloc(sizeof(int)*nodes_count);
+  int i,j,k,n,count,aggs = 0,best;
+  BOOL free_node;
+
+  /* Frobenius norms (squared) of diagonal blocks */
+  for (i = 0; i < nodes_count; ++ i)
+    for (k = node_offsets[i]; k < node_offsets[i+1]; ++ k)
+      for (j = A->offsets[k]; j < A->offsets[k+1]; ++ j)
+        if (dof_node[A->indexes[j]] == i)
+          norms[i] += A->values[j]*A->values[j];
+  /* graph of strong connections */
+  for (i = 0; i < nodes_count; ++ i)
+    mark[i] = -1;
+  xadj[0] = 0;
+  for (i = 0; i < nodes_count; ++ i)
+  {
+    count = 0;
+    for (k = node_offsets[i]; k < node_offsets[i+1]; ++ k)
+      for (j = A->offsets[k]; j < A->offsets[k+1]; ++ j)
+      {
+        n = dof_node[A->indexes[j]];
+        if (n == i)
+          continue;
+        if (mark[n] != i)
+        {
+          mark[n] = i;
+          acc[n] = 0;
+          list[count++] = n;
+        }
+        acc[n] += A->values[j]*A->values[j];
+      }
+    xadj[i+1] = xadj[i];
+    for (j = 0; j < count; ++ j)
+    {
+      n = list[j];
+      /* squared form of |A_in| >= strength*sqrt(|A_ii||A_nn|) */
+      if (acc[n] > 0 &&
+          acc[n]*acc[n] >=
+          strength*strength*strength*strength*norms[i]*norms[n])
+      {
+        if (xadj[i+1] == capacity)
+        {
+          capacity *= 2;
+          adj = (int*)realloc(adj,sizeof(int)*capacity);
+          weight = (real*)realloc(weight,sizeof(real)*capacity);
+        }
+        adj[xadj[i+1]] = n;
+        weight[xadj[i+1]++] = acc[n]/sqrt(norms[i]*norms[n]);
+      }
+    }
+  }
+
+  for (i = 0; i < nodes_count; ++ i)
+    agg[i] = -1;
+  /* 1st pass: nodes with all neighbors free form aggregates */
+  for (i = 0; i < nodes_count; ++ i)
+  {
+    if (agg[i] >= 0 || node_offsets[i] == node_offsets[i+1])
+      continue;
+    free_node = TRUE;
+    for (j = xadj[i]; j < xadj[i+1] && free_node; ++ j)
+      free_node = agg[adj[j]] < 0;
+    if (!free_node)
+      continue;
+    agg[i] = aggs;
+    for (j = xadj[i]; j < xadj[i+1]; ++ j)
+      agg[adj[j]] = aggs;
+    aggs ++;
+  }
+  /* 2nd pass: join the strongest neighbor aggregate of the 1st pass */
+  memcpy(pass1,agg,sizeof(int)*nodes_count);
+  for (i = 0; i < nodes_count; ++ i)
+  {
+    if (agg[i] >= 0 || node_offsets[i] == node_offsets[i+1])
+      continue;
+    best = -1;
+    for (j = xadj[i]; j < xadj[i+1]; ++ j)
+      if (pass1[adj[j]] >= 0 && (best < 0 || weight[j] > weight[best]))
+        best = j;
+    if (best >= 0)
+      agg[i] = pass1[adj[best]];
+  }
+  /* 3rd pass: the rest of nodes form aggregates with free neighbors */
+  for (i = 0; i < nodes_count; ++ i)
+  {
+    if (agg[i] >= 0 || node_offsets[i] == node_offsets[i+1])
+      continue;
+    agg[i] = aggs;
+    for (j = xadj[i]; j < xadj[i+1]; ++ j)
+      if (agg[adj[j]] < 0)
+        agg[adj[j]] = aggs;
+    aggs ++;
+  }
+  free(pass1);
+  free(weight);
+  free(adj);
+  free(xadj);
+  free(list);
+  free(mark);
+  free(acc);
+  free(norms);
+  return aggs;
+}
+
+/*
+ * Create tentative prolongator P by orthonormalization of the
+ * nullspace B [n x AMG_NULLSPACE_SIZE] restricted to aggregates.
+ * Outputs coarse nullspace *Bc and offsets of coarse nodes (aggregates)
+ */
+static void amg_tentative_prolongator(int n, int* dof_node, int* agg,
+                                      int aggs, real* B,
+                                      amg_matrix_ptr P, real** Bc,
+                                      int* coarse_offsets)
+{
+  const int ns = AMG_NULLSPACE_SIZE;
+  int* agg_offsets = (int*)calloc(aggs + 1,sizeof(int));
+  int* agg_dofs = (int*)malloc(sizeof(int)*(n > 0 ? n : 1));
+  real* Q = (real*)malloc(sizeof(real)*ns*(n > 0 ? n : 1));
+  real R[AMG_NULLSPACE_SIZE][AMG_NULLSPACE_SIZE];
+  int* cols = (int*)malloc(sizeof(int)*(aggs > 0 ? aggs : 1));
+  int a,i,j,k,q,m,c,nc;
+  real dot,norm,norm0;
+  real* v;
+
+  /* equations of every aggregate */
+  for (k = 0; k < n; ++ k)
+    agg_offsets[agg[dof_node[k]]+1] ++;
+  for (a = 0; a < aggs; ++ a)
+    agg_offsets[a+1] += agg_offsets[a];
+  for (k = 0; k < n; ++ k)
+    agg_dofs[agg_offsets[agg[dof_node[k]]]++] = k;
+  for (a = aggs; a > 0; -- a)
+    agg_offsets[a] = agg_offsets[a-1];
+  agg_offsets[0] = 0;
+
+  /*
+   * modified Gram-Schmidt per aggregate, Q is stored by columns
+   * of size m at Q + ns*agg_offsets[a]
+   */
+  *Bc = (real*)calloc(ns*ns*(aggs > 0 ? aggs : 1),sizeof(real));
+  coarse_offsets[0] = 0;
+  for (a = 0; a < aggs; ++ a)
+  {
+    m = agg_offsets[a+1] - agg_offsets[a];
+    c = 0;
+    memset(R,0,sizeof(R));
+    for (j = 0; j < ns; ++ j)
+    {
+      v = Q + ns*agg_offsets[a] + c*m;
+      for (i = 0; i < m; ++ i)
+        v[i] = B[agg_dofs[agg_offsets[a] + i]*ns + j];
+      norm0 = 0;
+      for (i = 0; i < m; ++ i)
+        norm0 += v[i]*v[i];
+      norm0 = sqrt(norm0);
+      for (q = 0; q < c; ++ q)
+      {
+        dot = 0;
+        for (i = 0; i < m; ++ i)
+          dot += Q[ns*agg_offsets[a] + q*m + i]*v[i];
+        for (i = 0; i < m; ++ i)
+          v[i] -= dot*Q[ns*agg_offsets[a] + q*m + i];
+        R[q][j] = dot;
+      }
+      norm = 0;
+      for (i = 0; i < m; ++ i)
+        norm += v[i]*v[i];
+      norm = sqrt(norm);
+      /* linearly dependent modes are dropped */
+      if (c < m && norm > AMG_DROP_TOLERANCE*norm0 && norm > 0)
+      {
+        for (i = 0; i < m; ++ i)
+          v[i] /= norm;
+        R[c][j] = norm;
+        c ++;
+      }
+    }
+    cols[a] = c;
+    coarse_offsets[a+1] = coarse_offsets[a] + c;
+    for (q = 0; q < c; ++ q)
+      for (j = 0; j < ns; ++ j)
+        (*Bc)[(coarse_offsets[a] + q)*ns + j] = R[q][j];
+  }
+  nc = coarse_offsets[aggs];
+
+  /* assemble P by rows */
+  amg_matrix_init(P,n,nc,n*ns);
+  for (k = 0; k < n; ++ k)
+    P->offsets[k+1] = P->offsets[k] + cols[agg[dof_node[k]]];
+  for (a = 0; a < aggs; ++ a)
+  {
+    m = agg_offsets[a+1] - agg_offsets[a];
+    for (i = 0; i < m; ++ i)
+    {
+      k = agg_dofs[agg_offsets[a] + i];
+      for (q = 0; q < cols[a]; ++ q)
+      {
+        P->indexes[P->offsets[k] + q] = coarse_offsets[a] + q;
+        P->values[P->offsets[k] + q] = Q[ns*agg_offsets[a] + q*m + i];
+      }
+    }
+  }
+  free(cols);
+  free(Q);
+  free(agg_dofs);
+  free(agg_offsets);
+}
+
+/* Estimate spectral radius of D^-1 A with power iterations */
+static real amg_spectral_radius(amg_matrix_ptr A, real* diag)
+{
+  int i,it;
+  int n = A->rows_count;
+  real* x = (real*)malloc(sizeof(real)*n);
+  real* y = (real*)malloc(sizeof(real)*n);
+  real norm,rho = 0;
+  for (i = 0; i < n; ++ i)
+    x[i] = 1.0 + (i % 7)/7.0;
+  for (it = 0; it < AMG_POWER_ITERATIONS; ++ it)
+  {
+    norm = 0;
+    for (i = 0; i < n; ++ i)
+      norm += x[i]*x[i];
+    norm = sqrt(norm);
+    if (norm == 0)
+      break;
+    for (i = 0; i < n; ++ i)
+      x[i] /= norm;
+    amg_matrix_mv(A,x,y);
+    rho = 0;
+    for (i = 0; i < n; ++ i)
+    {
+      x[i] = diag[i] != 0 ? y[i]/diag[i] : 0;
+      rho += x[i]*x[i];
+    }
+    rho = sqrt(rho);
+  }
+  free(y);
+  free(x);
+  return rho;
+}
+
+/* P = (I - omega/rho D^-1 A) * T */
+static void amg_smooth_prolongator(amg_matrix_ptr A, real* diag, real omega,
+                                   amg_matrix_ptr T, amg_matrix_ptr P)
+{
+  amg_matrix S;
+  int i,j;
+  real rho = amg_spectral_radius(A,diag);
+  real w = rho > 0 ? omega/rho : 0;
+  amg_matrix_init(&S,A->rows_count,A->cols_count,A->offsets[A->rows_count]);
+  memcpy(S.offsets,A->offsets,sizeof(int)*(A->rows_count+1));
+  memcpy(S.indexes,A->indexes,sizeof(int)*A->offsets[A->rows_count]);
+  for (i = 0; i < A->rows_count; ++ i)
+    for (j = A->offsets[i]; j < A->offsets[i+1]; ++ j)
+    {
+      S.values[j] = diag[i] != 0 ? -w*A->values[j]/diag[i] : 0;
+      if (A->indexes[j] == i)
+        S.values[j] += 1;
+    }
+  amg_matrix_mul(&S,T,P);
+  amg_matrix_free(&S);
+}
+
+/* Dense Cholesky factorization of the coarsest matrix */
+static real* amg_dense_factor(amg_matrix_ptr A)
+{
+  int n = A->rows_count;
+  int i,j,k;
+  real sum;
+  real* L = (real*)calloc(n > 0 ? n*n : 1,sizeof(real));
+  for (i = 0; i < n; ++ i)
+    for (j = A->offsets[i]; j < A->offsets[i+1]; ++ j)
+      L[i*n + A->indexes[j]] += A->values[j];
+  for (j = 0; j < n; ++ j)
+  {
+    sum = L[j*n + j];
+    for (k = 0; k < j; ++ k)
+      sum -= L[j*n + k]*L[j*n + k];
+    /* singular directions are left out of the solution */
+    L[j*n + j] = sum > 0 ? sqrt(sum) : 0;
+    for (i = j + 1; i < n; ++ i)
+    {
+      sum = L[i*n + j];
+      for (k = 0; k < j; ++ k)
+        sum -= L[i*n + k]*L[j*n + k];
+      L[i*n + j] = L[j*n + j] != 0 ? sum/L[j*n + j] : 0;
+    }
+  }
+  return L;
+}
+
+static void amg_dense_solve(real* L, int n, real* b, real* x)
+{
+  int i,j;
+  real sum;
+  for (i = 0; i < n; ++ i)
+  {
+    sum = b[i];
+    for (j = 0; j < i; ++ j)
+      sum -= L[i*n + j]*x[j];
+    x[i] = L[i*n + i] != 0 ? sum/L[i*n + i] : 0;
+  }
+  for (i = n - 1; i >= 0; -- i)
+  {
+    sum = x[i];
+    for (j = i + 1; j < n; ++ j)
+      sum -= L[j*n + i]*x[j];
+    x[i] = L[i*n + i] != 0 ? sum/L[i*n + i] : 0;
+  }
+}
+
+static void amg_level_init_work(amg_level* level)
+{
+  int n = level->A.rows_count > 0 ? level->A.rows_count : 1;
+  level->diag = amg_matrix_diag(&level->A);
+  level->x = (real*)calloc(n,sizeof(real));
+  level->b = (real*)calloc(n,sizeof(real));
+  level->r = (real*)calloc(n,sizeof(real));
+}
+
+amg_hierarchy_ptr amg_alloc(amg_params_ptr params,
+                            int n, int* offsets, int* indexes, real* values,
+                            int nodes_count, int* node_offsets,
+                            int* components,
+                            real (*coords)[MAX_DOF])
+{
+  const int ns = AMG_NULLSPACE_SIZE;
+  amg_hierarchy_ptr amg = (amg_hierarchy_ptr)calloc(1,sizeof(amg_hierarchy));
+  amg_level* level;
+  amg_matrix T,AP;
+  real center[MAX_DOF] = {0,0,0};
+  real x[MAX_DOF];
+  real *B,*Bc;
+  int *dof_node,*agg,*coarse_offsets,*offsets_level;
+  int i,k,d,aggs;
+
+  amg->params = *params;
+  amg->levels = (amg_level*)calloc(params->max_levels > 0 ?
+                                   params->max_levels : 1,
+                                   sizeof(amg_level));
+  /* finest level matrix */
+  level = &amg->levels[0];
+  amg_matrix_init(&level->A,n,n,offsets[n]);
+  memcpy(level->A.offsets,offsets,sizeof(int)*(n+1));
+  memcpy(level->A.indexes,indexes,sizeof(int)*offsets[n]);
+  memcpy(level->A.values,values,sizeof(real)*offsets[n]);
+  amg_level_init_work(level);
+  amg->levels_count = 1;
+
+  /* rigid body modes around the center of nodes */
+  for (i = 0; i < nodes_count; ++ i)
+    for (d = 0; d < MAX_DOF; ++ d)
+      center[d] += coords[i][d]/nodes_count;
+  B = (real*)calloc(ns*(n > 0 ? n : 1),sizeof(real));
+  dof_node = (int*)malloc(sizeof(int)*(n > 0 ? n : 1));
+  for (i = 0; i < nodes_count; ++ i)
+  {
+    for (d = 0; d < MAX_DOF; ++ d)
+      x[d] = coords[i][d] - center[d];
+    for (k = node_offsets[i]; k < node_offsets[i+1]; ++ k)
+    {
+      dof_node[k] = i;
+      d = components[k];
+      /* decoupled equations are out of the nullspace */
+      if (d < 0)
+        continue;
+      /* translations */
+      B[k*ns + d] = 1;
+      /* rotations around axes x, y, z */
+      B[k*ns + 3] = d == 1 ? -x[2] : (d == 2 ? x[1] : 0);
+      B[k*ns + 4] = d == 0 ? x[2] : (d == 2 ? -x[0] : 0);
+      B[k*ns + 5] = d == 0 ? -x[1] : (d == 1 ? x[0] : 0);
+    }
+  }
+  offsets_level = node_offsets;
+
+  /* coarsening */
+  while (amg->levels_count < params->max_levels &&
+         level->A.rows_count > params->coarse_size)
+  {
+    agg = (int*)malloc(sizeof(int)*(nodes_count > 0 ? nodes_count : 1));
+    aggs = amg_aggregate(&level->A,params->strength,nodes_count,
+                         offsets_level,dof_node,agg);
+    coarse_offsets = (int*)malloc(sizeof(int)*(aggs+1));
+    amg_tentative_prolongator(level->A.rows_count,dof_node,agg,aggs,B,
+                              &T,&Bc,coarse_offsets);
+    free(agg);
+    /* stop if coarsening stagnates: the coarse level shall be at least
+     * 20% smaller */
+    if (coarse_offsets[aggs] == 0 ||
+        5*coarse_offsets[aggs] > 4*level->A.rows_count)
+    {
+      amg_matrix_free(&T);
+      free(Bc);
+      free(coarse_offsets);
+      break;
+    }
+    amg_smooth_prolongator(&level->A,level->diag,params->prolongator_omega,
+                           &T,&level->P);
+    amg_matrix_free(&T);
+    amg_matrix_transpose(&level->P,&level->R);
+    /* Galerkin coarse matrix R*A*P */
+    amg_matrix_mul(&level->A,&level->P,&AP);
+    level = &amg->levels[amg->levels_count++];
+    amg_matrix_mul(&amg->levels[amg->levels_count-2].R,&AP,&level->A);
+    amg_matrix_free(&AP);
+    amg_level_init_work(level);
+    /* aggregates become nodes of the coarse level */
+    free(B);
+    B = Bc;
+    if (offsets_level != node_offsets)
+      free(offsets_level);
+    offsets_level = coarse_offsets;
+    nodes_count = aggs;
+    free(dof_node);
+    dof_node = (int*)malloc(sizeof(int)*(level->A.rows_count > 0 ?
+                                         level->A.rows_count : 1));
+    for (i = 0; i < nodes_count; ++ i)
+      for (k = offsets_level[i]; k < offsets_level[i+1]; ++ k)
+        dof_node[k] = i;
+  }
+  /*
+   * the dense factor needs n^2 memory and n^3 time, the coarsest level
+   * left large by the stagnation or the levels limit is smoothed instead
+   */
+  if (level->A.rows_count <= params->coarse_size)
+    amg->coarse_factor = amg_dense_factor(&level->A);
+
+  if (offsets_level != node_offsets)
+    free(offsets_level);
+  free(dof_node);
+  free(B);
+  return amg;
+}
+
+amg_hierarchy_ptr amg_free(amg_hierarchy_ptr amg)
+{
+  int l;
+  if (amg)
+  {
+    for (l = 0; l < amg->levels_count; ++ l)
+    {
+      amg_matrix_free(&amg->levels[l].A);
+      amg_matrix_free(&amg->levels[l].P);
+      amg_matrix_free(&amg->levels[l].R);
+      free(amg->levels[l].diag);
+      free(amg->levels[l].x);
+      free(amg->levels[l].b);
+      free(amg->levels[l].r);
+    }
+    free(amg->levels);
+    free(amg->coarse_factor);
+    free(amg);
+  }
+  return (amg_hierarchy_ptr)0;
+}
+
+
+/*************************************************************/
+/* Multigrid cycle                                           */
+
+/* Gauss-Seidel sweep, forward or backward */
+static void amg_gauss_seidel(amg_level* level, real* b, real* x,
+                             BOOL forward)
+{
+  amg_matrix_ptr A = &level->A;
+  int i,j,k;
+  real sum;
+  for (k = 0; k < A->rows_count; ++ k)
+  {
+    i = forward ? k : A->rows_count - 1 - k;
+    if (level->diag[i] == 0)
+      continue;
+    sum = b[i];
+    for (j = A->offsets[i]; j < A->offsets[i+1]; ++ j)
+      sum -= A->values[j]*x[A->indexes[j]];
+    x[i] += sum/level->diag[i];
+  }
+}
+
+static void amg_vcycle(amg_hierarchy_ptr amg, int l, real* b, real* x)
+{
+  amg_level* level = &amg->levels[l];
+  amg_level* coarse;
+  int i,s;
+  int n = level->A.rows_count;
+  if (l == amg->levels_count - 1)
+  {
+    if (amg->coarse_factor)
+      amg_dense_solve(amg->coarse_factor,n,b,x);
+    else
+    {
+      /* symmetric sweeps keep M symmetric */
+      memset(x,0,sizeof(real)*n);
+      for (s = 0; s < AMG_COARSE_SWEEPS; ++ s)
+      {
+        amg_gauss_seidel(level,b,x,TRUE);
+        amg_gauss_seidel(level,b,x,FALSE);
+      }
+    }
+    return;
+  }
+  coarse = &amg->levels[l+1];
+  memset(x,0,sizeof(real)*n);
+  /* forward sweeps before and backward after keep M symmetric */
+  for (s = 0; s < amg->params.smooth_steps; ++ s)
+    amg_gauss_seidel(level,b,x,TRUE);
+  /* coarse grid correction */
+  amg_matrix_mv(&level->A,x,level->r);
+  for (i = 0; i < n; ++ i)
+    level->r[i] = b[i] - level->r[i];
+  amg_matrix_mv(&level->R,level->r,coarse->b);
+  amg_vcycle(amg,l+1,coarse->b,coarse->x);
+  amg_matrix_mv(&level->P,coarse->x,level->r);
+  for (i = 0; i < n; ++ i)
+    x[i] += level->r[i];
+  for (s = 0; s < amg->params.smooth_steps; ++ s)
+    amg_gauss_seidel(level,b,x,FALSE);
+}
+
+void amg_cycle(void* data, real* b, real* x)
+{
+  amg_vcycle((amg_hierarchy_ptr)data,0,b,x);
+}
@@ -0,0 +1,104 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __AMG_H__
+#define __AMG_H__
+
+#include "defines.h"
+
+/*************************************************************/
+/* Smoothed aggregation algebraic multigrid preconditioner   */
+
+/* default threshold of the strength of connection between nodes */
+#define AMG_STRENGTH 0.08
+/* default maximum size of the coarsest system solved directly */
+#define AMG_COARSE_SIZE 500
+/* default maximum number of levels */
+#define AMG_MAX_LEVELS 10
+/* default number of pre- and post-smoothing steps */
+#define AMG_SMOOTH_STEPS 1
+/* default damping of the prolongator smoother, divided by the
+ * estimated spectral radius of D^-1 A */
+#define AMG_PROLONGATOR_OMEGA (4.0/3.0)
+
+/* number of symmetric Gauss-Seidel sweeps on the coarsest level if it
+ * is too large for the dense factorization */
+#define AMG_COARSE_SWEEPS 10
+
+/* number of rigid body modes in 3D */
+#define AMG_NULLSPACE_SIZE 6
+
+/* Parameters of the setup and of the cycle */
+typedef struct {
+  real strength;                /* nodes i,j are strongly connected if
+                                 * |A_ij| >= strength*sqrt(|A_ii||A_jj|),
+                                 * |.| is the Frobenius norm of the block */
+  int coarse_size;              /* stop coarsening when the number of
+                                 * equations is not greater than this */
+  int max_levels;               /* maximum number of levels */
+  int smooth_steps;             /* number of Gauss-Seidel sweeps before
+                                 * and after the coarse grid correction */
+  real prolongator_omega;       /* damping of the Jacobi smoother of the
+                                 * tentative prolongator */
+} amg_params;
+typedef amg_params* amg_params_ptr;
+
+/* Sparse matrix in the compressed row storage */
+typedef struct {
+  int rows_count;
+  int cols_count;
+  int* offsets;                 /* [rows_count + 1] */
+  int* indexes;                 /* column indexes [offsets[rows_count]] */
+  real* values;                 /* values [offsets[rows_count]] */
+} amg_matrix;
+typedef amg_matrix* amg_matrix_ptr;
+
+/* A level of the multigrid hierarchy */
+typedef struct {
+  amg_matrix A;                 /* matrix of the level */
+  amg_matrix P;                 /* prolongator from the next coarse level */
+  amg_matrix R;                 /* restriction to the next level, P^T */
+  real* diag;                   /* diagonal of A */
+  real* x;                      /* work vectors of the level size */
+  real* b;
+  real* r;
+} amg_level;
+
+/* Multigrid hierarchy */
+typedef struct {
+  amg_params params;
+  int levels_count;
+  amg_level* levels;            /* levels[0] is the finest */
+  real* coarse_factor;          /* dense Cholesky factor of the coarsest
+                                 * level matrix, stored by rows, 0 if the
+                                 * level is larger than coarse_size */
+} amg_hierarchy;
+typedef amg_hierarchy* amg_hierarchy_ptr;
+
+/*
+ * Build the multigrid hierarchy for the symmetric positive definite
+ * matrix given in compressed row (or column) storage.
+ * The d.o.f. are grouped by nodes: node i owns equations
+ * node_offsets[i]..node_offsets[i+1]-1. The near-nullspace is formed by
+ * 6 rigid body modes built from coordinates of nodes,
+ * components[k] is the coordinate direction (0,1,2) of the equation k
+ * or -1 if the equation is decoupled from the others (e.g. a fixed d.o.f.)
+ */
+amg_hierarchy_ptr amg_alloc(amg_params_ptr params,
+                            int n, int* offsets, int* indexes, real* values,
+                            int nodes_count, int* node_offsets,
+                            int* components,
+                            real (*coords)[MAX_DOF]);
+
+/* Deallocate the multigrid hierarchy */
+amg_hierarchy_ptr amg_free(amg_hierarchy_ptr amg);
+
+/*
+ * Apply one V-cycle to the system A*x = b with zero initial
+ * approximation: x = M^-1 b.
+ * The signature matches linear_operator_t, data is amg_hierarchy_ptr
+ */
+void amg_cycle(void* data, real* b, real* x);
+
+/* Matrix-vector product y = A*x */
+void amg_matrix_mv(amg_matrix_ptr A, real* x, real* y);
+
+#endif /* __AMG_H__ */
@@ -0,0 +1,246 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "binary_loader.h"
+
+/* round the offset up to the array alignment */
+static long long task_binary_align(long long offset)
+{
+  return (offset + TASK_BINARY_ALIGNMENT - 1)/TASK_BINARY_ALIGNMENT*
+    TASK_BINARY_ALIGNMENT;
+}
+
+/* write zeros up to the offset */
+static BOOL task_binary_pad(FILE* f, long long* position, long long offset)
+{
+  static const char zeros[TASK_BINARY_ALIGNMENT] = {0};
+  size_t size = (size_t)(offset - *position);
+  *position = offset;
+  return !size || fwrite(zeros,1,size,f) == size;
+}
+
+/*
+ * check node indexes of elements and prescribed nodes are inside the
+ * nodes array, they are used as subscripts by the solver
+ */
+static BOOL task_binary_indexes_valid(task_binary_header* header,
+                                      char* data)
+{
+  int i,j;
+  int nodes_per_element = header->fea_params.nodes_per_element;
+  int (*elements)[MAX_NODES_PER_ELEMENT] = (int(*)[MAX_NODES_PER_ELEMENT])
+    (data + header->elements_offset);
+  prescribed_bnd_node* presc = (prescribed_bnd_node*)
+    (data + header->prescribed_offset);
+  if (nodes_per_element < 0 || nodes_per_element > MAX_NODES_PER_ELEMENT)
+    return FALSE;
+  for (i = 0; i < header->elements_count; ++ i)
+    for (j = 0; j < nodes_per_element; ++ j)
+      if (elements[i][j] < 0 || elements[i][j] >= header->nodes_count)
+        return FALSE;
+  for (i = 0; i < header->prescribed_nodes_count; ++ i)
+    if (presc[i].node_number < 0 ||
+        presc[i].node_number >= header->nodes_count)
+      return FALSE;
+  return TRUE;
+}
+
+/* check the array [count] of size bytes per item lies inside the file */
+static BOOL task_binary_array_valid(long long offset, int count, int size,
+                                    long long file_size)
+{
+  return count >= 0 && offset >= (long long)sizeof(task_binary_header) &&
+    offset % TASK_BINARY_ALIGNMENT == 0 &&
+    offset + (long long)count*size <= file_size;
+}
+
+
+BOOL binary_data_save(char *filename,
+                      fea_task *task,
+                      fea_solution_params *fea_params,
+                      nodes_array *nodes,
+                      elements_array *elements,
+                      presc_bnd_array *presc_boundary)
+{
+  BOOL result;
+  long long position;
+  size_t size;
+  FILE* f;
+  task_binary_header header;
+
+  memset(&header,0,sizeof(header));
+  strcpy(header.magic,TASK_BINARY_MAGIC);
+  header.version = TASK_BINARY_VERSION;
+  header.byte_order = TASK_BINARY_BYTE_ORDER;
+  header.real_size = sizeof(real);
+  header.task_size = sizeof(fea_task);
+  header.params_size = sizeof(fea_solution_params);
+  header.bnd_node_size = sizeof(prescribed_bnd_node);
+  header.nodes_count = nodes->nodes_count;
+  header.elements_count = elements->elements_count;
+  header.prescribed_nodes_count = presc_boundary->prescribed_nodes_count;
+  header.nodes_offset = task_binary_align(sizeof(header));
+  header.elements_offset = task_binary_align(header.nodes_offset +
+    (long long)nodes->nodes_count*sizeof(real)*MAX_DOF);
+  header.prescribed_offset = task_binary_align(header.elements_offset +
+    (long long)elements->elements_count*sizeof(int)*MAX_NODES_PER_ELEMENT);
+  /* pointers are meaningless in the file */
+  header.task = *task;
+  header.task.export_file = (const char*)0;
+  header.task.mapped_data = (void*)0;
+  header.task.mapped_size = 0;
+  header.fea_params = *fea_params;
+
+  if (!(f = fopen(filename,"wb")))
+  {
+    fprintf(stderr,"Error, could not open file %s\n",filename);
+    return FALSE;
+  }
+  result = fwrite(&header,sizeof(header),1,f) == 1;
+  position = sizeof(header);
+  size = sizeof(real)*MAX_DOF*nodes->nodes_count;
+  result = result && task_binary_pad(f,&position,header.nodes_offset) &&
+    (!size || fwrite(nodes->nodes,1,size,f) == size);
+  position += size;
+  size = sizeof(int)*MAX_NODES_PER_ELEMENT*elements->elements_count;
+  result = result && task_binary_pad(f,&position,header.elements_offset) &&
+    (!size || fwrite(elements->elements,1,size,f) == size);
+  position += size;
+  size = sizeof(prescribed_bnd_node)*presc_boundary->prescribed_nodes_count;
+  result = result && task_binary_pad(f,&position,header.prescribed_offset) &&
+    (!size || fwrite(presc_boundary->prescribed_nodes,1,size,f) == size);
+  if (fclose(f))
+    result = FALSE;
+  if (!result)
+    fprintf(stderr,"Error, could not write file %s\n",filename);
+  return result;
+}
+
+
+BOOL binary_data_load(char *filename,
+                      fea_task **task,
+                      fea_solution_params **fea_params,
+                      nodes_array **nodes,
+                      elements_array **elements,
+                      presc_bnd_array **presc_boundary)
+{
+  int fd;
+  struct stat st;
+  char* data;
+  task_binary_header* header;
+  long long file_size;
+
+  if ((fd = open(filename,O_RDONLY)) < 0)
+  {
+    fprintf(stderr,"Error, could not open file %s\n",filename);
+    return FALSE;
+  }
+  if (fstat(fd,&st) || st.st_size < (off_t)sizeof(task_binary_header))
+  {
+    fprintf(stderr,"Error, %s is not a binary task file\n",filename);
+    close(fd);
+    return FALSE;
+  }
+  file_size = st.st_size;
+  /*
+   * private writable mapping: pages are read on demand and copied
+   * only if the solver modifies the arrays, the file stays intact
+   */
+  data = (char*)mmap((void*)0,(size_t)file_size,PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE,fd,0);
+  close(fd);
+  if (data == (char*)MAP_FAILED)
+  {
+    fprintf(stderr,"Error, could not map file %s\n",filename);
+    return FALSE;
+  }
+
+  header = (task_binary_header*)data;
+  if (memcmp(header->magic,TASK_BINARY_MAGIC,sizeof(header->magic)) ||
+      header->version != TASK_BINARY_VERSION ||
+      header->byte_order != TASK_BINARY_BYTE_ORDER ||
+      header->real_size != sizeof(real) ||
+      header->task_size != sizeof(fea_task) ||
+      header->params_size != sizeof(fea_solution_params) ||
+      header->bnd_node_size != sizeof(prescribed_bnd_node))
+  {
+    fprintf(stderr,"Error, %s is not a binary task file of this version\n",
+            filename);
+    munmap(data,(size_t)file_size);
+    return FALSE;
+  }
+  if (!task_binary_array_valid(header->nodes_offset,header->nodes_count,
+                               sizeof(real)*MAX_DOF,file_size) ||
+      !task_binary_array_valid(header->elements_offset,
+                               header->elements_count,
+                               sizeof(int)*MAX_NODES_PER_ELEMENT,
+                               file_size) ||
+      !task_binary_array_valid(header->prescribed_offset,
+                               header->prescribed_nodes_count,
+                               sizeof(prescribed_bnd_node),file_size))
+  {
+    fprintf(stderr,"Error, binary task file %s is truncated\n",filename);
+    munmap(data,(size_t)file_size);
+    return FALSE;
+  }
+
+  if (!task_binary_indexes_valid(header,data))
+  {
+    fprintf(stderr,"Error, binary task file %s has node indexes out of "
+            "range\n",filename);
+    munmap(data,(size_t)file_size);
+    return FALSE;
+  }
+
+  /* settings are small, copy them */
+  *task = fea_task_alloc();
+  **task = header->task;
+  (*task)->export_file = (const char*)0;
+  (*task)->mapped_data = data;
+  (*task)->mapped_size = (size_t)file_size;
+  *fea_params = fea_solution_params_alloc();
+  **fea_params = header->fea_params;
+
+  /* arrays point into the mapping */
+  *nodes = nodes_array_alloc();
+  (*nodes)->nodes_count = header->nodes_count;
+  if (header->nodes_count)
+  {
+    (*nodes)->nodes = (real(*)[MAX_DOF])(data + header->nodes_offset);
+    (*nodes)->mapped = TRUE;
+  }
+  *elements = elements_array_alloc();
+  (*elements)->elements_count = header->elements_count;
+  if (header->elements_count)
+  {
+    (*elements)->elements = (int(*)[MAX_NODES_PER_ELEMENT])
+      (data + header->elements_offset);
+    (*elements)->mapped = TRUE;
+  }
+  *presc_boundary = presc_bnd_array_alloc();
+  (*presc_boundary)->prescribed_nodes_count = header->prescribed_nodes_count;
+  if (header->prescribed_nodes_count)
+  {
+    (*presc_boundary)->prescribed_nodes = (prescribed_bnd_node*)
+      (data + header->prescribed_offset);
+    (*presc_boundary)->mapped = TRUE;
+  }
+  return TRUE;
+}
+
+void binary_data_unmap(fea_task *task)
+{
+  if (task->mapped_data)
+  {
+    munmap(task->mapped_data,task->mapped_size);
+    task->mapped_data = (void*)0;
+    task->mapped_size = 0;
+  }
+}
@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __BINARY_LOADER_H__
+#define __BINARY_LOADER_H__
+
+#include "defines.h"
+#include "fea_solver.h"
+
+/*************************************************************/
+/* Binary task file                                          */
+
+/*
+ * Layout of the file in the native byte order:
+ * task_binary_header, then nodes [nodes_count][MAX_DOF] reals,
+ * elements [elements_count][MAX_NODES_PER_ELEMENT] ints and
+ * prescribed_bnd_node [prescribed_nodes_count] structures.
+ * Every array starts at the offset aligned to TASK_BINARY_ALIGNMENT
+ */
+#define TASK_BINARY_MAGIC "FEATASK"
+#define TASK_BINARY_VERSION 1
+#define TASK_BINARY_ALIGNMENT 64
+/* stored as int, reads differently with the other byte order */
+#define TASK_BINARY_BYTE_ORDER 0x01020304
+
+typedef struct {
+  char magic[8];                /* TASK_BINARY_MAGIC */
+  int version;                  /* TASK_BINARY_VERSION */
+  int byte_order;               /* TASK_BINARY_BYTE_ORDER */
+  int real_size;                /* sizes of the stored structures, */
+  int task_size;                /* the file is rejected if they differ */
+  int params_size;              /* from the ones of the loader */
+  int bnd_node_size;
+  int nodes_count;
+  int elements_count;
+  int prescribed_nodes_count;
+  long long nodes_offset;       /* offsets of arrays from the file start */
+  long long elements_offset;
+  long long prescribed_offset;
+  fea_task task;                /* task without the export file name */
+  fea_solution_params fea_params;
+} task_binary_header;
+
+/*
+ * loader for the data from the binary task file.
+ * The file is mapped to memory, arrays of nodes, elements and
+ * boundary conditions point into the mapping which is owned by the task
+ */
+BOOL binary_data_load(char *filename,
+                      fea_task **task,
+                      fea_solution_params **fea_params,
+                      nodes_array **nodes,
+                      elements_array **elements,
+                      presc_bnd_array **presc_boundary);
+
+/* write the loaded data to the binary task file */
+BOOL binary_data_save(char *filename,
+                      fea_task *task,
+                      fea_solution_params *fea_params,
+                      nodes_array *nodes,
+                      elements_array *elements,
+                      presc_bnd_array *presc_boundary);
+
+/* unmap the file mapped by binary_data_load, if any */
+void binary_data_unmap(fea_task *task);
+
+#endif /* __BINARY_LOADER_H__ */
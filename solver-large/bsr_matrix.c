@@ -0,0 +1,126 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <stdlib.h>
+#include <string.h>
+#include "defines.h"
+#include "bsr_matrix.h"
+
+
+void bsr_matrix_init(bsr_matrix_ptr mtx, int block_rows, int* xadj, int* adj)
+{
+  int i,j,k,index;
+  int nnz = xadj[block_rows] + block_rows;
+
+  mtx->block_rows = block_rows;
+  mtx->offsets = (int*)malloc(sizeof(int)*(block_rows + 1));
+  mtx->indexes = (int*)malloc(sizeof(int)*(nnz > 0 ? nnz : 1));
+  mtx->values = (real(*)[BSR_BLOCK_SQR])calloc(nnz > 0 ? nnz : 1,
+                                               sizeof(real)*BSR_BLOCK_SQR);
+  k = 0;
+  for (i = 0; i < block_rows; ++ i)
+  {
+    mtx->offsets[i] = k;
+    mtx->indexes[k++] = i;
+    /* insertion sort, rows are short */
+    for (j = xadj[i]; j < xadj[i+1]; ++ j)
+    {
+      index = k++;
+      while (index > mtx->offsets[i] && mtx->indexes[index-1] > adj[j])
+      {
+        mtx->indexes[index] = mtx->indexes[index-1];
+        index --;
+      }
+      mtx->indexes[index] = adj[j];
+    }
+  }
+  mtx->offsets[block_rows] = k;
+}
+
+void bsr_matrix_free(bsr_matrix_ptr mtx)
+{
+  free(mtx->offsets);
+  free(mtx->indexes);
+  free(mtx->values);
+  memset(mtx,0,sizeof(bsr_matrix));
+}
+
+void bsr_matrix_clear(bsr_matrix_ptr mtx)
+{
+  memset(mtx->values,0,
+         sizeof(real)*BSR_BLOCK_SQR*mtx->offsets[mtx->block_rows]);
+}
+
+int bsr_matrix_block(bsr_matrix_ptr mtx, int row, int col)
+{
+  int low = mtx->offsets[row];
+  int high = mtx->offsets[row+1] - 1;
+  int middle;
+  /* binary search, indexes are sorted */
+  while (low <= high)
+  {
+    middle = (low + high)/2;
+    if (mtx->indexes[middle] == col)
+      return middle;
+    if (mtx->indexes[middle] < col)
+      low = middle + 1;
+    else
+      high = middle - 1;
+  }
+  return -1;
+}
+
+real* bsr_matrix_element(bsr_matrix_ptr mtx, int row, int col)
+{
+  int block = bsr_matrix_block(mtx,row/BSR_BLOCK_SIZE,col/BSR_BLOCK_SIZE);
+  if (block < 0)
+    return (real*)0;
+  return &mtx->values[block][(row%BSR_BLOCK_SIZE)*BSR_BLOCK_SIZE +
+                             col%BSR_BLOCK_SIZE];
+}
+
+void bsr_matrix_mv(bsr_matrix_ptr mtx, real* x, real* y)
+{
+  int i,k;
+  real y0,y1,y2;
+  real* a;
+  real* xb;
+  /* the block is unrolled, partial sums are kept in registers */
+#pragma omp parallel for private(k,y0,y1,y2,a,xb) schedule(static)
+  for (i = 0; i < mtx->block_rows; ++ i)
+  {
+    y0 = y1 = y2 = 0;
+    for (k = mtx->offsets[i]; k < mtx->offsets[i+1]; ++ k)
+    {
+      a = mtx->values[k];
+      xb = x + BSR_BLOCK_SIZE*mtx->indexes[k];
+      y0 += a[0]*xb[0] + a[1]*xb[1] + a[2]*xb[2];
+      y1 += a[3]*xb[0] + a[4]*xb[1] + a[5]*xb[2];
+      y2 += a[6]*xb[0] + a[7]*xb[1] + a[8]*xb[2];
+    }
+    y[BSR_BLOCK_SIZE*i]   = y0;
+    y[BSR_BLOCK_SIZE*i+1] = y1;
+    y[BSR_BLOCK_SIZE*i+2] = y2;
+  }
+}
+
+void bsr_matrix_csr(bsr_matrix_ptr mtx,
+                    int** offsets, int** indexes, real** values)
+{
+  int i,r,c,k,count = 0;
+  int n = mtx->block_rows*BSR_BLOCK_SIZE;
+  int nnz = mtx->offsets[mtx->block_rows]*BSR_BLOCK_SQR;
+  *offsets = (int*)malloc(sizeof(int)*(n+1));
+  *indexes = (int*)malloc(sizeof(int)*(nnz > 0 ? nnz : 1));
+  *values = (real*)malloc(sizeof(real)*(nnz > 0 ? nnz : 1));
+  for (i = 0; i < mtx->block_rows; ++ i)
+    for (r = 0; r < BSR_BLOCK_SIZE; ++ r)
+    {
+      (*offsets)[i*BSR_BLOCK_SIZE + r] = count;
+      for (k = mtx->offsets[i]; k < mtx->offsets[i+1]; ++ k)
+        for (c = 0; c < BSR_BLOCK_SIZE; ++ c)
+        {
+          (*indexes)[count] = mtx->indexes[k]*BSR_BLOCK_SIZE + c;
+          (*values)[count++] = mtx->values[k][r*BSR_BLOCK_SIZE + c];
+        }
+    }
+  (*offsets)[n] = count;
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __BSR_MATRIX_H__
+#define __BSR_MATRIX_H__
+
+#include "defines.h"
+
+/*************************************************************/
+/* Sparse matrix in the block compressed row storage         */
+
+/* size of the dense block, the number of d.o.f. per node */
+#define BSR_BLOCK_SIZE 3
+#define BSR_BLOCK_SQR (BSR_BLOCK_SIZE*BSR_BLOCK_SIZE)
+
+/*
+ * Square matrix of BSR_BLOCK_SIZE x BSR_BLOCK_SIZE blocks.
+ * Block columns of the block row i are
+ * indexes[offsets[i]..offsets[i+1]-1] sorted in ascending order,
+ * the block k is values[k] stored by rows
+ */
+typedef struct {
+  int block_rows;               /* number of block rows (nodes) */
+  int* offsets;                 /* [block_rows + 1] */
+  int* indexes;                 /* block column indexes */
+  real (*values)[BSR_BLOCK_SQR];/* blocks */
+} bsr_matrix;
+typedef bsr_matrix* bsr_matrix_ptr;
+
+/*
+ * Create the pattern of the matrix from the adjacency graph of block
+ * rows: neighbors of the row i are adj[xadj[i]..xadj[i+1]-1], the
+ * diagonal block is always added. Values are set to zero
+ */
+void bsr_matrix_init(bsr_matrix_ptr mtx, int block_rows, int* xadj, int* adj);
+
+/* Deallocate the contents of the matrix */
+void bsr_matrix_free(bsr_matrix_ptr mtx);
+
+/* Set to zero all values keeping the pattern */
+void bsr_matrix_clear(bsr_matrix_ptr mtx);
+
+/*
+ * Index of the block (row,col) in the values array.
+ * Returns -1 if the block is not in the pattern
+ */
+int bsr_matrix_block(bsr_matrix_ptr mtx, int row, int col);
+
+/* Pointer to the scalar element (row,col) or 0 if not in the pattern */
+real* bsr_matrix_element(bsr_matrix_ptr mtx, int row, int col);
+
+/* Matrix-vector product y = A*x */
+void bsr_matrix_mv(bsr_matrix_ptr mtx, real* x, real* y);
+
+/*
+ * Expand the matrix to the scalar compressed row storage,
+ * arrays are allocated by the function
+ */
+void bsr_matrix_csr(bsr_matrix_ptr mtx,
+                    int** offsets, int** indexes, real** values);
+
+#endif /* __BSR_MATRIX_H__ */
@@ -19,6 +19,9 @@ typedef int BOOL;
 #define TRUE 1
 
 #define MAX_DOF 3
+#define MAX_NODES_PER_ELEMENT 10
+/* maximum size of the local stiffness matrix */
+#define MAX_ELEMENT_DOF (MAX_NODES_PER_ELEMENT*MAX_DOF)
 #define MAX_MATERIAL_PARAMETERS 10
 
 /* define specific macros used by GCC compiler */
@@ -29,9 +32,15 @@ typedef int BOOL;
  */
 #define DEPRECATED __attribute__ ((deprecated))
 #define UNUSED __attribute__ ((unused))
+/*
+ * Use this macro after declaration of the variable or structure member:
+ * real array[10] ALIGNED(16);
+ */
+#define ALIGNED(x) __attribute__ ((aligned (x)))
 #else
 #define DEPRECATED
 #define UNUSED
+#define ALIGNED(x)
 #endif /* __GNUC__ */
 
 /* Redefine type of the floating point values */
@@ -0,0 +1,100 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <stdlib.h>
+#include <pthread.h>
+#include "defines.h"
+#include "export_queue.h"
+
+struct export_queue_tag {
+  pthread_t thread;             /* writer thread */
+  pthread_mutex_t mutex;        /* protects all fields below */
+  pthread_cond_t not_empty;     /* signalled on push and on finish */
+  pthread_cond_t not_full;      /* signalled when an item is taken */
+  void** items;                 /* ring buffer [capacity] */
+  int capacity;
+  int head;                     /* index of the oldest item */
+  int count;                    /* number of items in the queue */
+  BOOL finished;                /* no more items will be pushed */
+  export_consumer_t consumer;
+  void* data;
+};
+
+static void* export_queue_thread(void* arg)
+{
+  export_queue_ptr queue = (export_queue_ptr)arg;
+  void* item;
+  for (;;)
+  {
+    pthread_mutex_lock(&queue->mutex);
+    while (!queue->count && !queue->finished)
+      pthread_cond_wait(&queue->not_empty,&queue->mutex);
+    if (!queue->count)
+    {
+      /* finished and nothing left */
+      pthread_mutex_unlock(&queue->mutex);
+      break;
+    }
+    item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count --;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+    /* the item is processed outside of the lock */
+    queue->consumer(queue->data,item);
+  }
+  return (void*)0;
+}
+
+export_queue_ptr export_queue_alloc(int capacity,
+                                    export_consumer_t consumer,
+                                    void* data)
+{
+  export_queue_ptr queue =
+    (export_queue_ptr)calloc(1,sizeof(struct export_queue_tag));
+  queue->capacity = capacity > 0 ? capacity : 1;
+  queue->items = (void**)malloc(sizeof(void*)*queue->capacity);
+  queue->consumer = consumer;
+  queue->data = data;
+  pthread_mutex_init(&queue->mutex,0);
+  pthread_cond_init(&queue->not_empty,0);
+  pthread_cond_init(&queue->not_full,0);
+  if (pthread_create(&queue->thread,0,export_queue_thread,queue))
+  {
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue->items);
+    free(queue);
+    return (export_queue_ptr)0;
+  }
+  return queue;
+}
+
+void export_queue_push(export_queue_ptr queue, void* item)
+{
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->count == queue->capacity)
+    pthread_cond_wait(&queue->not_full,&queue->mutex);
+  queue->items[(queue->head + queue->count) % queue->capacity] = item;
+  queue->count ++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+export_queue_ptr export_queue_free(export_queue_ptr queue)
+{
+  if (queue)
+  {
+    pthread_mutex_lock(&queue->mutex);
+    queue->finished = TRUE;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+    /* the thread exits when the queue is empty */
+    pthread_join(queue->thread,0);
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue->items);
+    free(queue);
+  }
+  return (export_queue_ptr)0;
+}
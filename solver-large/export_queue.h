@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __EXPORT_QUEUE_H__
+#define __EXPORT_QUEUE_H__
+
+#include "defines.h"
+
+/*************************************************************/
+/* Bounded queue processed by a background writer thread     */
+
+/* default number of items waiting in the queue */
+#define EXPORT_QUEUE_SIZE 2
+
+/*
+ * A pointer to the function processing one item in the writer thread.
+ * data - consumer-specific data passed to export_queue_alloc
+ */
+typedef void (*export_consumer_t)(void* data, void* item);
+
+/* the queue is opaque, it hides the threading library */
+typedef struct export_queue_tag* export_queue_ptr;
+
+/*
+ * Start the writer thread calling consumer for every pushed item
+ * in the order of pushes. capacity is the maximum number of items
+ * waiting in the queue.
+ * Returns 0 if the thread could not be started
+ */
+export_queue_ptr export_queue_alloc(int capacity,
+                                    export_consumer_t consumer,
+                                    void* data);
+
+/*
+ * Pass the item to the writer thread, which owns it afterwards.
+ * Blocks while the queue is full
+ */
+void export_queue_push(export_queue_ptr queue, void* item);
+
+/*
+ * Wait until all pushed items are processed, stop the writer thread
+ * and deallocate the queue
+ */
+export_queue_ptr export_queue_free(export_queue_ptr queue);
+
+#endif /* __EXPORT_QUEUE_H__ */
@@ -11,10 +11,12 @@ void fea_model_init(fea_model_ptr self, model_type type)
   case MODEL_A5:
     self->stress = fea_model_stress_A5;
     self->ctensor = fea_model_ctensor_A5;
+    self->ctensor_voigt = fea_model_ctensor_voigt_A5;
     break;
   case MODEL_COMPRESSIBLE_NEOHOOKEAN:
     self->stress = fea_model_stress_compr_neohookean;
     self->ctensor = fea_model_ctensor_compr_neohookean;
+    self->ctensor_voigt = fea_model_ctensor_voigt_compr_neohookean;
     break;
   default:
     assert(FALSE);
@@ -146,3 +148,46 @@ void fea_model_ctensor_compr_neohookean(fea_model_ptr self,
             + 2*mu1 * DELTA (i, k) * DELTA (j, l);
   
 }
+
+
+/*
+ * Fill the matrix D of the isotropic tensor
+ * C = lambda E \otimes E + 2 mu I (symmetric 4th rank identity)
+ * in Voigt notation
+ */
+static void fea_model_isotropic_voigt(real lambda, real mu,
+                                      real (*dmatrix)[VOIGT_SIZE])
+{
+  int i,j;
+  for ( i = 0; i < VOIGT_SIZE; ++ i )
+    for ( j = 0; j < VOIGT_SIZE; ++ j )
+      dmatrix[i][j] = 0;
+  for ( i = 0; i < MAX_DOF; ++ i )
+  {
+    for ( j = 0; j < MAX_DOF; ++ j )
+      dmatrix[i][j] = lambda;
+    dmatrix[i][i] += 2*mu;
+    dmatrix[i+MAX_DOF][i+MAX_DOF] = mu;
+  }
+}
+
+void fea_model_ctensor_voigt_A5(fea_model_ptr self,
+                                real (*graddef)[MAX_DOF],
+                                real (*dmatrix)[VOIGT_SIZE])
+{
+  real detF = det3x3(graddef);
+  real lambda = self->parameters[0];
+  real mu = self->parameters[1];
+  fea_model_isotropic_voigt(lambda/detF, mu/detF, dmatrix);
+}
+
+void fea_model_ctensor_voigt_compr_neohookean(fea_model_ptr self,
+                                              real (*graddef)[MAX_DOF],
+                                              real (*dmatrix)[VOIGT_SIZE])
+{
+  real J = det3x3(graddef);
+  real lambda = self->parameters[0];
+  real mu = self->parameters[1];
+  /* 2*mu1*DELTA(i,k)*DELTA(j,l) symmetrized by (i,j) and (k,l) */
+  fea_model_isotropic_voigt(lambda/J, (mu - lambda*log(J))/J, dmatrix);
+}
@@ -5,6 +5,9 @@
 #include "dense_matrix.h"
 
 
+/* size of the symmetric 2nd rank tensor in Voigt notation */
+#define VOIGT_SIZE 6
+
 /*************************************************************/
 /* Forward declarations                                      */
 
@@ -30,6 +33,17 @@ typedef void (*ctensor_func_t)(fea_model_ptr self,
                                real (*graddef)[MAX_DOF],
                                real (*ctensor)[MAX_DOF][MAX_DOF][MAX_DOF]);
 
+/*
+ * A pointer to the function for calculating the C elasticity tensor
+ * in Voigt notation by given deformation gradient.
+ * The result is the symmetric VOIGT_SIZE x VOIGT_SIZE matrix D with
+ * components ordered as 11, 22, 33, 12, 23, 13, i.e. with the C tensor
+ * symmetrized by the 1st and 2nd pairs of indexes
+ */
+typedef void (*ctensor_voigt_func_t)(fea_model_ptr self,
+                                     real (*graddef)[MAX_DOF],
+                                     real (*dmatrix)[VOIGT_SIZE]);
+
 
 /*************************************************************/
 /* Enumerations declarations                                 */
@@ -54,6 +68,9 @@ struct fea_model {
   ctensor_func_t ctensor; /* a function pointer to the C elasticity
                            * tensor
                            */
+  ctensor_voigt_func_t ctensor_voigt; /* a function pointer to the C
+                                       * elasticity tensor in Voigt
+                                       * notation */
 };
 
 
@@ -99,6 +116,22 @@ void fea_model_ctensor_compr_neohookean(fea_model_ptr self,
                                         real (*graddef)[MAX_DOF],
                                         real (*ctensor)[MAX_DOF][MAX_DOF][MAX_DOF]);
 
+/*
+ * Calculate C tensor of the elastic material model A5
+ * in Voigt notation by given deformation gradient
+ */
+void fea_model_ctensor_voigt_A5(fea_model_ptr self,
+                                real (*graddef)[MAX_DOF],
+                                real (*dmatrix)[VOIGT_SIZE]);
+
+/*
+ * Calculate C tensor of the Neo-hookean compressible material model
+ * in Voigt notation by given deformation gradient
+ */
+void fea_model_ctensor_voigt_compr_neohookean(fea_model_ptr self,
+                                              real (*graddef)[MAX_DOF],
+                                              real (*dmatrix)[VOIGT_SIZE]);
+
 
 
 
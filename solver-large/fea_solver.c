@@ -7,6 +7,9 @@
 #include "dense_matrix.h"
 #include "tests.h"
 #include "sexp_loader.h"
+#include "binary_loader.h"
+#include "ordering.h"
+#include "pcg.h"
 
 #include "sp_matrix.h"
 #include "sp_direct.h"
@@ -16,6 +19,10 @@
 
 #include "logger.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 
 
 /*
@@ -64,7 +71,9 @@ void error(char* msg)
 int main(int argc, char **argv)
 {
   char* filename = 0;
+  char* convert = 0;
   int result = 0;
+  int format = -1;
   char logfilename[255];
   /* Initialize logger */
   logger_parameters params;
@@ -81,7 +90,8 @@ int main(int argc, char **argv)
   
   do
   {
-    if ( TRUE == (result = parse_cmdargs(argc, argv,&filename)))
+    if ( TRUE == (result = parse_cmdargs(argc, argv,&filename,&format,
+                                         &convert)))
       break;
     /* initialize logger */
     sprintf(logfilename,"%s.log",argv[0]);
@@ -90,14 +100,17 @@ int main(int argc, char **argv)
     params.use_stdout = 1;
     logger_init_with_params(&params);
     /* start the calculation */
-    result = do_main(filename);
+    if (convert)
+      result = do_convert(filename,convert);
+    else
+      result = do_main(filename,format);
     logger_fini();
   } while(0);
 
   return result;
 }
 
-int do_main(char* filename)
+int do_main(char* filename, int format)
 {
   /* initialize variables */
   int result = 0;
@@ -121,12 +134,61 @@ int do_main(char* filename)
   else                          /* solve task */
   {
     LOG("Initial data loaded");
+    if (format >= 0)
+      task->export_format = (export_format_type)format;
     
     solve(task, fea_params, nodes, elements, presc_boundary);
   }
   return result;
 }
 
+int do_convert(char* filename, char* output)
+{
+  int result = 0;
+  fea_task_ptr task = (fea_task_ptr)0;
+  fea_solution_params_ptr fea_params = (fea_solution_params_ptr)0;
+  nodes_array_ptr nodes = (nodes_array_ptr)0;
+  elements_array_ptr elements = (elements_array_ptr)0;
+  presc_bnd_array_ptr presc_boundary = (presc_bnd_array_ptr)0;
+
+  if(!initial_data_load(filename,
+                        &task,
+                        &fea_params,
+                        &nodes,
+                        &elements,
+                        &presc_boundary))
+  {
+    LOGERROR("Error. Unable to load %s.",filename);
+    return 1;
+  }
+  if (binary_data_save(output,task,fea_params,nodes,elements,presc_boundary))
+    LOGINFO("Converted %s to %s",filename,output);
+  else
+  {
+    LOGERROR("Error. Unable to write %s.",output);
+    result = 1;
+  }
+  presc_bnd_array_free(presc_boundary);
+  elements_array_free(elements);
+  nodes_array_free(nodes);
+  fea_solution_params_free(fea_params);
+  fea_task_free(task);
+  return result;
+}
+
+/*
+ * Write the load step in the export thread, data is fea_solver_ptr.
+ * Only the immutable mesh data of the solver is used
+ */
+static void solver_export_consumer(void* data, void* item)
+{
+  fea_solver_ptr solver = (fea_solver_ptr)data;
+  load_step_ptr step = (load_step_ptr)item;
+  solver->export_step(solver,solver->export_stream,step);
+  solver_load_step_free(solver,step);
+  free(step);
+}
+
 void solve( fea_task_ptr task,
             fea_solution_params_ptr fea_params,
             nodes_array_ptr nodes,
@@ -135,9 +197,6 @@ void solve( fea_task_ptr task,
 {
   /* initialize variables */
   fea_solver_ptr solver = (fea_solver_ptr)0;
-  int it = 0;
-  real tolerance;
-  sp_matrix stiffness;
 #ifdef DUMP_DATA
   /* Dump all data in debug version */
   dump_input_data("input.txt",task,fea_params,nodes,elements,presc_boundary);
@@ -159,176 +218,1272 @@ void solve( fea_task_ptr task,
   LOG("Create an array of shape functions gradients in initial configuration");
   solver_create_initial_shape_gradients(solver);
 
-  /* Increment loop starts here */
-  for (; solver->current_load_step < solver->task_p->load_increments_count;
-       ++ solver->current_load_step)
+  /*
+   * the arc-length constraint needs the coupling of free and prescribed
+   * d.o.f., which is not stored with eliminated prescribed d.o.f.
+   */
+  if (task->arclength_max > 0 &&
+      (task->eliminate_prescribed || task->matrix_free))
   {
-    it = 0;
-    /* apply prescribed displacements */
-    solver_update_nodes_with_bc(solver, 1);
+    LOGERROR("Arc-length method requires prescribed d.o.f. in the global "
+             "system, using load increments");
+    task->arclength_max = 0;
+  }
+  /* converged steps are appended to the export file as they finish */
+  LOG("Exporting data to %s",task->export_file);
+  solver->export_stream = solver->export_open(solver,task->export_file);
+  if (!solver->export_stream)
+    LOGERROR("Unable to create the export file %s",task->export_file);
+  else
+  {
+    /* formatting of results overlaps with the next load steps */
+    solver->export_queue = export_queue_alloc(EXPORT_QUEUE_SIZE,
+                                              solver_export_consumer,
+                                              solver);
+    if (!solver->export_queue)
+      LOGERROR("Unable to start the export thread, exporting synchronously");
+  }
+  if (task->arclength_max > 0)
+    solver_arc_length_steps(solver);
+  else
+    solver_load_control_steps(solver);
+  
+  fea_solver_free(solver);
+}
 
-    /* Create an array of shape functions gradients in current configuration */
-    solver_create_current_shape_gradients(solver);
-    /* create stresses in order to use them in residual forces and in
-     * initial stress component of the stiffness matrix */
-    solver_create_stresses(solver);
+/*
+ * Store the converged state as the next load step and append it to
+ * the export file. Only the last LOAD_STEPS_HISTORY steps are kept
+ */
+static void solver_store_load_step(fea_solver_ptr solver, real load)
+{
+  load_step_ptr step =
+    &solver->load_steps_p[solver->current_load_step % LOAD_STEPS_HISTORY];
+  load_step_ptr snapshot;
+  int size = solver->elements_p->elements_count*
+    solver->fea_params_p->gauss_nodes_count;
+  LOG("Load increment %d finished, load %f",
+      solver->current_load_step+1,load);
+  if (solver->current_load_step >= LOAD_STEPS_HISTORY)
+    solver_load_step_free(solver,step);
+  solver_load_step_init(solver,step,solver->current_load_step);
+  step->load = load;
+  solver->current_load_step ++;
+  if (solver->export_queue)
+  {
+    /* the writer thread gets its own copy of the results */
+    snapshot = (load_step_ptr)malloc(sizeof(load_step));
+    snapshot->step_number = step->step_number;
+    snapshot->load = load;
+    snapshot->nodes_p = nodes_array_copy_alloc(step->nodes_p);
+    snapshot->stresses = (tensor*)malloc(sizeof(tensor)*size);
+    memcpy(snapshot->stresses,step->stresses,sizeof(tensor)*size);
+    snapshot->graddefs = (tensor*)0;
+    export_queue_push(solver->export_queue,snapshot);
+  }
+  else if (solver->export_stream)
+    solver->export_step(solver,solver->export_stream,step);
+}
 
-    /* create global stiffness matrix K */
-    solver_create_stiffness(solver);
-    /* store global stiffness matrix for modified Newton method */
-    sp_matrix_copy(&solver->global_mtx,&stiffness);
-    do 
-    {
-      it ++;
+void solver_load_control_steps(fea_solver_ptr solver)
+{
+  nodes_array_ptr converged_nodes = (nodes_array_ptr)0;
+  int it = 0;
+  /* reached multiplier of prescribed displacements and its increment */
+  real load = 0,increment = 1,factor;
+  BOOL last = FALSE;
 
-      /* create right-side vector of residual forces (-R) */
-      solver_create_residual_forces(solver);
+  /* saved converged configuration to restart a failed increment from */
+  if (solver->task_p->adaptive_increments)
+    converged_nodes = nodes_array_copy_alloc(solver->nodes_p);
 
-      /* create global stiffness matrix K */
-      if (solver->task_p->modified_newton) 
+  /* Increment loop starts here */
+  while (!last)
+  {
+    /* the last increment reaches the total load exactly */
+    if (load + increment >= solver->task_p->load_increments_count)
+    {
+      increment = solver->task_p->load_increments_count - load;
+      last = TRUE;
+    }
+    if (converged_nodes)
+      memcpy(converged_nodes->nodes,solver->nodes_p->nodes,
+             sizeof(real)*MAX_DOF*solver->nodes_p->nodes_count);
+    /* apply prescribed displacements, free nodes follow the path if any */
+    if (!solver_predict_nodes(solver,increment))
+      solver_update_nodes_with_bc(solver, increment);
+    if (!solver_newton_iterations(solver,&it))
+    {
+      if (!converged_nodes ||
+          increment*ADAPTIVE_CUTBACK < solver->task_p->min_increment)
       {
-        /*
-         * use stored  stiffness matrix in
-         * modified Newton method
-         */
-        sp_matrix_free(&solver->global_mtx);
-        sp_matrix_copy(&stiffness,&solver->global_mtx);
+        LOGERROR("Unable to finish load step in %d Newton iterations,exit",
+                 it);
+        break;
       }
-      else                        
+      /* retry from the last converged configuration with a smaller step */
+      memcpy(solver->nodes_p->nodes,converged_nodes->nodes,
+             sizeof(real)*MAX_DOF*solver->nodes_p->nodes_count);
+      increment *= ADAPTIVE_CUTBACK;
+      last = FALSE;
+      LOG("Load increment cut back to %f",increment);
+      continue;
+    }
+    load = last ? solver->task_p->load_increments_count : load + increment;
+    solver_store_load_step(solver,load);
+    /* next increment grows if Newton converged fast and vice versa */
+    if (converged_nodes)
+    {
+      factor = (real)solver->task_p->target_newton_count/it;
+      factor = fmin(fmax(factor,ADAPTIVE_CUTBACK),ADAPTIVE_MAX_GROWTH);
+      increment = fmin(fmax(increment*factor,solver->task_p->min_increment),
+                       solver->task_p->max_increment);
+    }
+  }
+  if (converged_nodes)
+    nodes_array_free(converged_nodes);
+}
+
+void solver_arc_length_steps(fea_solver_ptr solver)
+{
+  nodes_array_ptr converged_nodes = nodes_array_copy_alloc(solver->nodes_p);
+  int it = 0,steps = 0;
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  int nodes_size = sizeof(real)*MAX_DOF*solver->nodes_p->nodes_count;
+  /* displacements of the last converged step and of the current one */
+  real* delta0 = (real*)calloc(size,sizeof(real));
+  real* delta = (real*)malloc(sizeof(real)*size);
+  real total = solver->task_p->load_increments_count;
+  real load = 0,dlambda = 0,length = 0,factor;
+  /* bounds of the arc length */
+  real min_length = 0,max_length = 0;
+  BOOL converged;
+
+  while (load < total)
+  {
+    if (steps == solver->task_p->arclength_max)
+    {
+      LOGERROR("Total load is not reached in %d arc-length steps, load %f",
+               steps,load);
+      break;
+    }
+    memcpy(converged_nodes->nodes,solver->nodes_p->nodes,nodes_size);
+    memcpy(delta,delta0,sizeof(real)*size);
+    converged = solver_arc_length_iterations(solver,delta,&length,&dlambda,
+                                             &it);
+    if (length == 0)
+    {
+      LOGERROR("Unable to compute the tangent of the first arc-length step,"
+               " exit");
+      break;
+    }
+    /*
+     * the bounds are relative to the length of one load increment,
+     * the first computed length, even if its step does not converge
+     */
+    if (max_length == 0)
+    {
+      min_length = length*solver->task_p->min_increment;
+      max_length = length*solver->task_p->max_increment;
+    }
+    if (converged)
+    {
+      if (load + dlambda < total)
       {
-        /* create global stiffness otherwise */
-        solver_create_stiffness(solver);
+        load += dlambda;
+        steps ++;
+        solver_store_load_step(solver,load);
+        memcpy(delta0,delta,sizeof(real)*size);
+        /* Crisfield's rule for the next arc length */
+        factor = sqrt((real)solver->task_p->target_newton_count/it);
+        factor = fmin(fmax(factor,ADAPTIVE_CUTBACK),ADAPTIVE_MAX_GROWTH);
+        length = fmin(fmax(length*factor,min_length),max_length);
+        continue;
       }
+      /* the step passes the total load: finish with a load increment */
+      memcpy(solver->nodes_p->nodes,converged_nodes->nodes,nodes_size);
+      solver_update_nodes_with_bc(solver,total - load);
+      if (solver_newton_iterations(solver,&it))
+      {
+        load = total;
+        solver_store_load_step(solver,load);
+        break;
+      }
+    }
+    /* retry from the last converged configuration with a shorter arc */
+    memcpy(solver->nodes_p->nodes,converged_nodes->nodes,nodes_size);
+    length *= ADAPTIVE_CUTBACK;
+    if (length < min_length || length == 0)
+    {
+      LOGERROR("Unable to finish arc-length step in %d Newton iterations,"
+               " exit",it);
+      break;
+    }
+    LOG("Arc length cut back to %e",length);
+  }
+  free(delta);
+  free(delta0);
+  nodes_array_free(converged_nodes);
+}
+
+BOOL solver_arc_length_iterations(fea_solver_ptr solver,
+                                  real* delta, real* length,
+                                  real* dlambda, int* iterations)
+{
+  int i,it = 0;
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  real* x = solver->global_solution_vct;
+  real* f = solver->global_forces_vct;
+  /* displacements per unit load and the residual forces (-R) */
+  real* tangent = (real*)malloc(sizeof(real)*size);
+  real* residual = (real*)malloc(sizeof(real)*size);
+  real tolerance,first_tolerance = 0;
+  real a,b,c,d,root;
+  BOOL converged = FALSE;
+  BOOL solved;
+
+  solver_create_current_shape_gradients(solver);
+  solver_create_stresses(solver);
+  solver_create_stiffness(solver);
+  /*
+   * the tangent displacements are the solution for the unit multiplier
+   * of prescribed displacements without residual forces: the cross
+   * cancellation moves the columns of prescribed d.o.f. to the right side
+   */
+  memset(f,0,sizeof(real)*size);
+  solver_apply_prescribed_bc(solver,1);
+  solved = solver_solve_slae(solver);
+  if (solved)
+  {
+    memcpy(tangent,x,sizeof(real)*size);
+    /* the first arc length is the one of the whole load increment */
+    if (*length == 0)
+      *length = sqrt(cdot(tangent,tangent,size));
+    /* predictor keeps the direction of the previous step */
+    *dlambda = *length/sqrt(cdot(tangent,tangent,size));
+    if (cdot(tangent,delta,size) < 0)
+      *dlambda = -*dlambda;
+    for (i = 0; i < size; ++ i)
+      delta[i] = *dlambda*tangent[i];
+    solver_update_nodes_with_solution(solver,delta);
+    LOG("Arc-length predictor, load increment %f",*dlambda);
+  }
+  while (solved && !converged && it < solver->task_p->max_newton_count)
+  {
+    it ++;
+    solver_create_current_shape_gradients(solver);
+    solver_create_stresses(solver);
+    solver_create_residual_forces(solver);
+    if (!solver->task_p->modified_newton)
+    {
+      /* new tangent displacements at the current configuration */
+      memcpy(residual,f,sizeof(real)*size);
+      solver_create_stiffness(solver);
+      memset(f,0,sizeof(real)*size);
+      solver_apply_prescribed_bc(solver,1);
+      if (!(solved = solver_solve_slae(solver)))
+        break;
+      memcpy(tangent,x,sizeof(real)*size);
+      memcpy(f,residual,sizeof(real)*size);
+    }
+    /* correction of the residual forces at the fixed load */
+    solver_apply_prescribed_bc_forces(solver,0);
+    if (!(solved = solver_solve_slae(solver)))
+      break;
+    tolerance = cdot(f,x,size);
+    LOG("Tolerance <X,R> = %e",tolerance);
+    LOG("Newton iteration %d finished",it);
+    if (isnan(tolerance) ||
+        (it > 1 && fabs(tolerance) > fabs(first_tolerance)))
+    {
+      solved = FALSE;
+      break;
+    }
+    if (it == 1)
+      first_tolerance = tolerance;
+    /*
+     * the load correction dl keeps the step on the sphere
+     * |delta + x + dl*tangent| = length, Crisfield 1981
+     */
+    a = cdot(tangent,tangent,size);
+    b = c = 0;
+    for (i = 0; i < size; ++ i)
+    {
+      b += tangent[i]*(delta[i] + x[i]);
+      c += (delta[i] + x[i])*(delta[i] + x[i]);
+    }
+    b *= 2;
+    c -= *length**length;
+    d = b*b - 4*a*c;
+    if (d < 0)
+    {
+      LOGERROR("Arc-length constraint has no real roots");
+      solved = FALSE;
+      break;
+    }
+    /*
+     * the root with the least angle between the old and the new step
+     * displacements, delta*(delta + x + root*tangent) is maximal
+     */
+    if (cdot(delta,tangent,size) >= 0)
+      root = (-b + sqrt(d))/(2*a);
+    else
+      root = (-b - sqrt(d))/(2*a);
+    for (i = 0; i < size; ++ i)
+    {
+      x[i] += root*tangent[i];
+      delta[i] += x[i];
+    }
+    *dlambda += root;
+    solver_update_nodes_with_solution(solver,x);
+    converged = fabs(tolerance) <= solver->task_p->desired_tolerance;
+  }
+  free(residual);
+  free(tangent);
+  *iterations = it;
+  return solved && converged;
+}
+
+/*
+ * Eisenstat-Walker forcing term of the Newton iteration it from the
+ * norm of the residual forces with applied boundary conditions
+ * (Eisenstat & Walker 1996, choice 2 with safeguards)
+ */
+static void solver_update_forcing_term(fea_solver_ptr solver, int it)
+{
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  real norm = sqrt(cdot(solver->global_forces_vct,
+                        solver->global_forces_vct,size));
+  real eta,safeguard;
+  eta = solver->task_p->max_forcing_term;
+  if (it > 1 && solver->residual_norm > 0)
+  {
+    eta = FORCING_TERM_GAMMA*pow(norm/solver->residual_norm,
+                                 FORCING_TERM_ALPHA);
+    /* do not tighten too fast if the previous term was loose */
+    safeguard = FORCING_TERM_GAMMA*pow(solver->forcing_term,
+                                       FORCING_TERM_ALPHA);
+    if (safeguard > 0.1)
+      eta = fmax(eta,safeguard);
+    eta = fmin(eta,solver->task_p->max_forcing_term);
+  }
+  solver->forcing_term = eta;
+  solver->residual_norm = norm;
+}
+
+/* Relative tolerance of the next iterative solve */
+static real solver_linear_tolerance(fea_solver_ptr solver)
+{
+  return fmax(solver->forcing_term,solver->task_p->solver_tolerance);
+}
+
+/*
+ * Store the last step of nodes as the displacement s of the next
+ * BFGS pair, dropping the oldest pair if all are used
+ */
+static void solver_bfgs_store_step(fea_solver_ptr solver)
+{
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  if (solver->bfgs_count == solver->task_p->bfgs_max)
+  {
+    solver->bfgs_count --;
+    memmove(solver->bfgs_s,solver->bfgs_s + size,
+            sizeof(real)*size*solver->bfgs_count);
+    memmove(solver->bfgs_y,solver->bfgs_y + size,
+            sizeof(real)*size*solver->bfgs_count);
+    memmove(solver->bfgs_rho,solver->bfgs_rho + 1,
+            sizeof(real)*solver->bfgs_count);
+  }
+  memcpy(solver->bfgs_s + size*solver->bfgs_count,
+         solver->global_solution_vct,sizeof(real)*size);
+}
+
+/*
+ * Complete the BFGS pair with the change of the residual forces over
+ * the stored step, y = R_new - R_old. The pair is skipped if it does
+ * not keep the updated matrix positive definite
+ */
+static void solver_bfgs_update(fea_solver_ptr solver)
+{
+  int i;
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  real* s = solver->bfgs_s + size*solver->bfgs_count;
+  real* y = solver->bfgs_y + size*solver->bfgs_count;
+  real ys;
+  /* forces vectors are -R */
+  for (i = 0; i < size; ++ i)
+    y[i] = solver->bfgs_forces[i] - solver->global_forces_vct[i];
+  ys = cdot(y,s,size);
+  if (ys > 0)
+  {
+    solver->bfgs_rho[solver->bfgs_count] = 1/ys;
+    solver->bfgs_count ++;
+  }
+}
+
+/*
+ * Solve the global system with the inverse of the kept tangent
+ * updated by the stored BFGS pairs, two-loop recursion
+ * (Matthies & Strang 1979, Nocedal 1980). The right-hand side
+ * global_forces_vct is overwritten
+ */
+static BOOL solver_solve_slae_bfgs(fea_solver_ptr solver)
+{
+  int i,k;
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  real* q = solver->global_forces_vct;
+  real* x = solver->global_solution_vct;
+  real* s;
+  real* y;
+  real beta;
+  for (k = solver->bfgs_count - 1; k >= 0; -- k)
+  {
+    s = solver->bfgs_s + size*k;
+    y = solver->bfgs_y + size*k;
+    solver->bfgs_alpha[k] = solver->bfgs_rho[k]*cdot(s,q,size);
+    for (i = 0; i < size; ++ i)
+      q[i] -= solver->bfgs_alpha[k]*y[i];
+  }
+  if (!solver_solve_slae(solver))
+    return FALSE;
+  for (k = 0; k < solver->bfgs_count; ++ k)
+  {
+    s = solver->bfgs_s + size*k;
+    y = solver->bfgs_y + size*k;
+    beta = solver->bfgs_rho[k]*cdot(y,x,size);
+    for (i = 0; i < size; ++ i)
+      x[i] += (solver->bfgs_alpha[k] - beta)*s[i];
+  }
+  return TRUE;
+}
+
+BOOL solver_newton_iterations(fea_solver_ptr solver, int* iterations)
+{
+  int it = 0;
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  real tolerance,first_tolerance = 0;
+  BOOL converged = FALSE;
+
+  /* secant updates are valid for the tangent of this step only */
+  solver->bfgs_count = 0;
+
+  /* Create an array of shape functions gradients in current configuration */
+  solver_create_current_shape_gradients(solver);
+  /* create stresses in order to use them in residual forces and in
+   * initial stress component of the stiffness matrix */
+  solver_create_stresses(solver);
+
+  /* create global stiffness matrix K */
+  solver_create_stiffness(solver);
+  do 
+  {
+    it ++;
+
+    /* create right-side vector of residual forces (-R) */
+    solver_create_residual_forces(solver);
+
+    /*
+     * the matrix-free operator uses the current configuration,
+     * so its tangents are refreshed on every iteration
+     */
+    if ((solver->task_p->modified_newton || solver->bfgs_s) && it > 1 &&
+        !solver->task_p->matrix_free)
+    {
+      /*
+       * in modified Newton method the global stiffness matrix
+       * with applied boundary conditions (and its factorization,
+       * if any) is kept for the whole load step, so only the
+       * right-side vector needs boundary conditions
+       */
+      solver_apply_prescribed_bc_forces(solver,0);
+    }
+    else                        
+    {
+      /* create global stiffness otherwise */
+      if (it > 1)
+        solver_create_stiffness(solver);
       /* apply prescribed boundary conditions */
       solver_apply_prescribed_bc(solver,0);
+    }
+    /* the linear solve is as accurate as the linearization */
+    if (solver->task_p->inexact_newton)
+      solver_update_forcing_term(solver,it);
+    if (solver->bfgs_s)
+    {
+      /* the kept tangent corrected with secant updates */
+      if (it > 1)
+        solver_bfgs_update(solver);
+      memcpy(solver->bfgs_forces,solver->global_forces_vct,sizeof(real)*size);
+      if (!solver_solve_slae_bfgs(solver))
+        break;
+      tolerance = cdot(solver->bfgs_forces,solver->global_solution_vct,size);
+    }
+    else
+    {
       /* solve global equation system K*u=-R */
-      solver_solve_slae(solver);
+      if (!solver_solve_slae(solver))
+        break;
       /* check for convergence */
-
       tolerance = cdot(solver->global_forces_vct,
-                       solver->global_solution_vct,
-                       solver->global_mtx.rows_count);
-    
-      LOG("Tolerance <X,R> = %e",tolerance);
-      LOG("Newton iteration %d finished",it);
+                       solver->global_solution_vct,size);
+    }
     
-      /* update nodes array with solution */
-      solver_update_nodes_with_solution(solver,solver->global_solution_vct);
-      solver_create_current_shape_gradients(solver);
-      solver_create_stresses(solver);
-
-    } while ( fabs(tolerance) > solver->task_p->desired_tolerance &&
-              it < task->max_newton_count);
-    /* clear stored stiffness matrix */
-    sp_matrix_free(&stiffness);
-    LOG("Load increment %d finished",solver->current_load_step+1);
-    if (it == solver->task_p->max_newton_count)
-    {
-      solver->current_load_step--;
-      LOGERROR("Unable to finish load step in %d Newton iterations,exit",
-               solver->task_p->max_newton_count);
+    LOG("Tolerance <X,R> = %e",tolerance);
+    LOG("Newton iteration %d finished",it);
+    /*
+     * with adaptive increments a diverging step is cut back
+     * as soon as the energy norm grows
+     */
+    if (isnan(tolerance) ||
+        (solver->task_p->adaptive_increments && it > 1 &&
+         fabs(tolerance) > fabs(first_tolerance)))
       break;
-    }
-    /* store current load step */
-    solver_load_step_init(solver,
-                          &solver->load_steps_p[solver->current_load_step],
-                          solver->current_load_step);
-  }
-  /* export solution */
-  LOG("Exporting data...");
-  solver->export_function(solver,task->export_file);
-  
-  fea_solver_free(solver);
+    if (it == 1)
+      first_tolerance = tolerance;
+    
+    /* update nodes array with solution */
+    solver_update_nodes_with_solution(solver,solver->global_solution_vct);
+    solver_create_current_shape_gradients(solver);
+    solver_create_stresses(solver);
+    /* scale the step if the full Newton step overshoots */
+    if (solver->task_p->linesearch_max > 0)
+      solver_line_search(solver,tolerance);
+    if (solver->bfgs_s)
+      solver_bfgs_store_step(solver);
+    converged = fabs(tolerance) <= solver->task_p->desired_tolerance;
+  } while (!converged && it < solver->task_p->max_newton_count);
+  /* other solves use the tolerance of the iterative solver */
+  solver->forcing_term = 0;
+  *iterations = it;
+  return converged;
 }
 
 
 static BOOL solver_solve_slae_cg(fea_solver_ptr solver,
-                                 sp_matrix_yale_ptr mtx)
+                                 sp_matrix_yale_ptr mtx,
+                                 real* b, real* x)
 {
   int iter = solver->task_p->solver_max_iter;
-  real tolerance = solver->task_p->solver_tolerance;
-
-  sp_matrix_yale_solve_cg(mtx,
-                          solver->global_forces_vct,
-                          solver->global_forces_vct,
-                          &iter,
-                          &tolerance,
-                          solver->global_solution_vct);
+  real tolerance = solver_linear_tolerance(solver);
+
+  sp_matrix_yale_solve_cg(mtx,b,b,&iter,&tolerance,x);
   return TRUE;
 }
 
-static BOOL solver_solve_slae_pcg_ilu(fea_solver_ptr solver,
-                                      sp_matrix_yale_ptr mtx)
+/* Deallocate cached ILU preconditioner if any */
+static void solver_ilu_free(fea_solver_ptr solver)
 {
-  sp_matrix_skyline_ilu ilu;
+  if (solver->ilu)
+  {
+    sp_matrix_skyline_ilu_free(solver->ilu);
+    free(solver->ilu);
+    solver->ilu = (sp_matrix_skyline_ilu_ptr)0;
+  }
+}
 
+static BOOL solver_solve_slae_pcg_ilu(fea_solver_ptr solver,
+                                      sp_matrix_yale_ptr mtx,
+                                      real* b, real* x)
+{
   int iter = solver->task_p->solver_max_iter;
-  real tolerance = solver->task_p->solver_tolerance;
+  real tolerance = solver_linear_tolerance(solver);
+  real requested_tolerance = tolerance;
 
-  sp_matrix_create_ilu(&solver->global_mtx, &ilu);
+  /*
+   * the preconditioner is kept between solves since the tangent
+   * matrix changes a little between Newton iterations and load steps.
+   * It is rebuilt after every ilu_refresh_count solves
+   */
+  if (solver->ilu && solver->ilu_solves >= solver->task_p->ilu_refresh_count)
+    solver_ilu_free(solver);
+  if (!solver->ilu)
+  {
+    solver->ilu = calloc(1,sizeof(sp_matrix_skyline_ilu));
+    sp_matrix_create_ilu(&solver->global_mtx, solver->ilu);
+    solver->ilu_solves = 0;
+    solver->ilu_base_iter = 0;
+    solver->ilu_base_tolerance = 0;
+    LOGINFO("ILU preconditioner created");
+  }
 
-  sp_matrix_yale_solve_pcg_ilu(mtx,
-                               &ilu,
-                               solver->global_forces_vct,
-                               solver->global_forces_vct,
-                               &iter,
-                               &tolerance,
-                               solver->global_solution_vct);
+  sp_matrix_yale_solve_pcg_ilu(mtx,solver->ilu,b,b,&iter,&tolerance,x);
+  LOGINFO("PCG finished in %d iterations",iter);
+  
+  solver->ilu_solves ++;
+  /*
+   * drop the preconditioner if it became too poor for the current
+   * matrix: PCG hasn't converged or the number of iterations grown
+   * too much since the first solve with it. Iteration counts are
+   * comparable only at the same tolerance, which changes with the
+   * forcing term of the inexact Newton method, so the base solve is
+   * the last one with a new tolerance. A zero right side takes no
+   * iterations and is no base either
+   */
+  if (iter >= solver->task_p->solver_max_iter)
+    solver_ilu_free(solver);
+  else if (!solver->ilu_base_iter ||
+           requested_tolerance != solver->ilu_base_tolerance)
+  {
+    solver->ilu_base_iter = iter;
+    solver->ilu_base_tolerance = requested_tolerance;
+  }
+  else if (iter > solver->task_p->ilu_refresh_factor*solver->ilu_base_iter)
+    solver_ilu_free(solver);
+  return TRUE;
+}
+
+/* Operator of the global system for the PCG, data is sp_matrix_yale_ptr */
+static void solver_yale_operator(void* data, real* x, real* y)
+{
+  sp_matrix_yale_mv((sp_matrix_yale_ptr)data,x,y);
+}
+
+/* Operator of the global system stored by blocks, data is bsr_matrix_ptr */
+static void solver_bsr_operator(void* data, real* x, real* y)
+{
+  bsr_matrix_mv((bsr_matrix_ptr)data,x,y);
+}
 
-  sp_matrix_skyline_ilu_free(&ilu);
+/*
+ * Create the AMG hierarchy for the global stiffness matrix of size n
+ * given in the compressed row storage.
+ * Equations are grouped by nodes, rigid body modes are built from
+ * nodes in the current configuration. If reduced is TRUE the matrix
+ * contains only free equations, otherwise all d.o.f. with
+ * decoupled eliminated ones
+ */
+static void solver_create_amg(fea_solver_ptr solver, int n,
+                              int* offsets, int* indexes, real* values,
+                              BOOL reduced)
+{
+  int i,j,index;
+  int dof = solver->task_p->dof;
+  int nodes_count = solver->nodes_p->nodes_count;
+  int* node_offsets = (int*)malloc(sizeof(int)*(nodes_count+1));
+  int* components = (int*)malloc(sizeof(int)*n);
+  /* equations of every node are numbered sequentially */
+  node_offsets[0] = 0;
+  for (i = 0; i < nodes_count; ++ i)
+  {
+    node_offsets[i+1] = node_offsets[i];
+    for (j = 0; j < dof; ++ j)
+    {
+      index = reduced ? solver->equations[i*dof + j] : i*dof + j;
+      if (index >= 0)
+      {
+        components[index] = solver->equations[i*dof + j] >= 0 ? j : -1;
+        node_offsets[i+1] ++;
+      }
+    }
+  }
+  solver->amg = amg_alloc(&solver->task_p->amg,
+                          n,offsets,indexes,values,
+                          nodes_count,node_offsets,components,
+                          solver->nodes_p->nodes);
+  LOGINFO("AMG hierarchy created, %d levels",solver->amg->levels_count);
+  for (i = 0; i < solver->amg->levels_count; ++ i)
+    LOGINFO("AMG level %d: %d equations",
+            i,solver->amg->levels[i].A.rows_count);
+  if (!solver->amg->coarse_factor)
+    LOGINFO("AMG coarsest level is larger than %d equations, "
+            "smoothed with %d Gauss-Seidel sweeps",
+            solver->task_p->amg.coarse_size,AMG_COARSE_SWEEPS);
+  free(components);
+  free(node_offsets);
+}
+
+static BOOL solver_solve_slae_pcg_amg(fea_solver_ptr solver,
+                                      sp_matrix_yale_ptr mtx,
+                                      real* b, real* x)
+{
+  int iter;
+  real tolerance = solver_linear_tolerance(solver);
+
+  /* the hierarchy is kept while the global matrix is not changed */
+  /* the matrix is symmetric, so CCS storage is the same as CRS */
+  if (!solver->amg)
+    solver_create_amg(solver,mtx->rows_count,
+                      mtx->offsets,mtx->indicies,mtx->values,
+                      TRUE);
+  memset(x,0,sizeof(real)*mtx->rows_count);
+  iter = pcg_solve(mtx->rows_count,
+                   solver_yale_operator,mtx,
+                   amg_cycle,solver->amg,
+                   b,x,
+                   solver->task_p->solver_max_iter,&tolerance);
+  LOGINFO("PCG finished in %d iterations, residual %e",iter,tolerance);
   return TRUE;
 }
 
+/*
+ * Product of the local stiffness matrix of the element by the vector x
+ * added to y. The local stiffness is not formed: in every gauss node
+ * K_e*x_e = B^T D (B x_e) + initial stress term, with the gradient of
+ * x_e computed once. Eliminated d.o.f. are skipped
+ */
+static void solver_local_stiffness_mv(fea_solver_ptr self, int element,
+                                      real* x, real* y)
+{
+  shape_gradients_ptr grads;
+  int gauss,a,i,k,l,index;
+  int dof = self->task_p->dof;
+  int nelem = self->fea_params_p->nodes_per_element;
+  int gauss_count = self->fea_params_p->gauss_nodes_count;
+  int* nodes = self->elements_p->elements[element];
+  tensor_ptr stresses = self->stresses + element*gauss_count;
+  real (*D)[VOIGT_SIZE];
+  real (*stress)[MAX_DOF];
+  /* local vectors x_e and y_e */
+  real xe[MAX_NODES_PER_ELEMENT][MAX_DOF];
+  real ye[MAX_NODES_PER_ELEMENT][MAX_DOF];
+  /* gradient of x_e: H_ik = sum_b x_bi dN_b/dx_k */
+  real H[MAX_DOF][MAX_DOF];
+  /* initial stress term, volume * S*H^T */
+  real M[MAX_DOF][MAX_DOF];
+  /* B x_e in Voigt notation and volume * D*B*x_e */
+  real eps[VOIGT_SIZE],s[VOIGT_SIZE];
+  real ga[MAX_DOF];
+  real volume;
+
+  assert(dof == MAX_DOF);
+  for (a = 0; a < nelem; ++ a)
+    for (i = 0; i < dof; ++ i)
+    {
+      index = nodes[a]*dof + i;
+      xe[a][i] = self->equations[index] >= 0 ? x[index] : 0;
+      ye[a][i] = 0;
+    }
+  for (gauss = 0; gauss < gauss_count; ++ gauss)
+  {
+    grads = solver_shape_gradients(self,TRUE,element,gauss);
+    D = self->tangents[element*gauss_count + gauss];
+    stress = stresses[gauss].components;
+    volume = fabs(grads->detJ)*self->elements_db.gauss_nodes[gauss]->weight;
+
+    memset(H,0,sizeof(H));
+    for (a = 0; a < nelem; ++ a)
+      for (i = 0; i < dof; ++ i)
+        for (k = 0; k < dof; ++ k)
+          H[i][k] += xe[a][i]*grads->grads[k][a];
+    /* rows of B as in solver_local_stiffness */
+    eps[0] = H[0][0];
+    eps[1] = H[1][1];
+    eps[2] = H[2][2];
+    eps[3] = H[0][1] + H[1][0];
+    eps[4] = H[1][2] + H[2][1];
+    eps[5] = H[0][2] + H[2][0];
+    for (k = 0; k < VOIGT_SIZE; ++ k)
+    {
+      s[k] = 0;
+      for (l = 0; l < VOIGT_SIZE; ++ l)
+        s[k] += D[k][l]*eps[l];
+      s[k] *= volume;
+    }
+    for (k = 0; k < dof; ++ k)
+      for (i = 0; i < dof; ++ i)
+      {
+        M[k][i] = 0;
+        for (l = 0; l < dof; ++ l)
+          M[k][i] += stress[k][l]*H[i][l];
+        M[k][i] *= volume;
+      }
+    for (a = 0; a < nelem; ++ a)
+    {
+      ga[0] = grads->grads[0][a];
+      ga[1] = grads->grads[1][a];
+      ga[2] = grads->grads[2][a];
+      ye[a][0] += ga[0]*s[0] + ga[1]*s[3] + ga[2]*s[5];
+      ye[a][1] += ga[1]*s[1] + ga[0]*s[3] + ga[2]*s[4];
+      ye[a][2] += ga[2]*s[2] + ga[1]*s[4] + ga[0]*s[5];
+      for (i = 0; i < dof; ++ i)
+        ye[a][i] += ga[0]*M[0][i] + ga[1]*M[1][i] + ga[2]*M[2][i];
+    }
+  }
+  for (a = 0; a < nelem; ++ a)
+    for (i = 0; i < dof; ++ i)
+    {
+      index = nodes[a]*dof + i;
+      if (self->equations[index] >= 0)
+        y[index] += ye[a][i];
+    }
+}
+
+/*
+ * Matrix-free operator of the global system, data is fea_solver_ptr.
+ * Eliminated d.o.f. are unit equations
+ */
+static void solver_element_operator(void* data, real* x, real* y)
+{
+  fea_solver_ptr solver = (fea_solver_ptr)data;
+  int color,i;
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  memset(y,0,sizeof(real)*size);
+  /* elements of the same color do not update the same components */
+  for (color = 0; color < solver->colors_count; ++ color)
+  {
+#pragma omp parallel for schedule(static)
+    for (i = solver->colors_offsets[color];
+         i < solver->colors_offsets[color+1]; ++ i)
+      solver_local_stiffness_mv(solver,solver->colored_elements[i],x,y);
+  }
+  if (solver->equations_count != size)
+    for (i = 0; i < size; ++ i)
+      if (solver->equations[i] < 0)
+        y[i] = x[i];
+}
+
+/* Block-Jacobi or Jacobi preconditioner, data is fea_solver_ptr */
+static void solver_node_blocks_prec(void* data, real* x, real* y)
+{
+  fea_solver_ptr solver = (fea_solver_ptr)data;
+  int i;
+  real* block;
+  real* xb;
+#pragma omp parallel for private(block,xb) schedule(static)
+  for (i = 0; i < solver->nodes_p->nodes_count; ++ i)
+  {
+    block = solver->node_blocks[i];
+    xb = x + i*MAX_DOF;
+    y[i*MAX_DOF]   = block[0]*xb[0] + block[1]*xb[1] + block[2]*xb[2];
+    y[i*MAX_DOF+1] = block[3]*xb[0] + block[4]*xb[1] + block[5]*xb[2];
+    y[i*MAX_DOF+2] = block[6]*xb[0] + block[7]*xb[1] + block[8]*xb[2];
+  }
+}
+
+/*
+ * Solve the global system for all d.o.f. with CG or PCG.
+ * Eliminated prescribed d.o.f. are decoupled equations with zero
+ * right-hand side
+ */
+static BOOL solver_solve_slae_all_dof(fea_solver_ptr solver,
+                                      linear_operator_t op, void* op_data,
+                                      linear_operator_t prec,
+                                      void* prec_data)
+{
+  int i,iter;
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  real tolerance = solver_linear_tolerance(solver);
+  real* b = solver->global_forces_vct;
+  real* x = solver->global_solution_vct;
+
+  if (solver->equations_count != size)
+  {
+    b = (real*)malloc(sizeof(real)*size);
+    for (i = 0; i < size; ++ i)
+      b[i] = solver->equations[i] >= 0 ? solver->global_forces_vct[i] : 0;
+  }
+  memset(x,0,sizeof(real)*size);
+  iter = pcg_solve(size,op,op_data,prec,prec_data,b,x,
+                   solver->task_p->solver_max_iter,&tolerance);
+  LOGINFO("%s finished in %d iterations, residual %e",
+          prec ? "PCG" : "CG",iter,tolerance);
+  if (b != solver->global_forces_vct)
+    free(b);
+  return TRUE;
+}
+
+/* Solve the global system stored by blocks with CG or PCG_AMG */
+static BOOL solver_solve_slae_block(fea_solver_ptr solver)
+{
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  linear_operator_t prec = (linear_operator_t)0;
+  int* offsets;
+  int* indexes;
+  real* values;
+
+  if (solver->task_p->solver_type == PCG_AMG)
+  {
+    /* the hierarchy is kept while the global matrix is not changed */
+    if (!solver->amg)
+    {
+      bsr_matrix_csr(&solver->global_bsr,&offsets,&indexes,&values);
+      solver_create_amg(solver,size,offsets,indexes,values,FALSE);
+      free(values);
+      free(indexes);
+      free(offsets);
+    }
+    prec = amg_cycle;
+  }
+  return solver_solve_slae_all_dof(solver,
+                                   solver_bsr_operator,&solver->global_bsr,
+                                   prec,solver->amg);
+}
+
+/*
+ * Solve L*L^T*x = b with the lower triangular Cholesky factor L
+ * stored either by columns (CCS) or by rows (CRS) with the diagonal
+ * element first in every column/row
+ */
+static void solver_chol_factor_solve(sp_matrix_yale_ptr L, real* b, real* x)
+{
+  int i,j;
+  int n = L->rows_count;
+  memcpy(x,b,sizeof(real)*n);
+  if (L->storage_type == CCS)
+  {
+    /* forward substitution L*y = b by columns */
+    for (j = 0; j < n; ++ j)
+    {
+      x[j] /= L->values[L->offsets[j]];
+      for (i = L->offsets[j] + 1; i < L->offsets[j+1]; ++ i)
+        x[L->indicies[i]] -= L->values[i]*x[j];
+    }
+    /* backward substitution L^T*x = y, rows of L^T are columns of L */
+    for (j = n-1; j >= 0; -- j)
+    {
+      for (i = L->offsets[j] + 1; i < L->offsets[j+1]; ++ i)
+        x[j] -= L->values[i]*x[L->indicies[i]];
+      x[j] /= L->values[L->offsets[j]];
+    }
+  }
+  else
+  {
+    /* forward substitution L*y = b by rows */
+    for (j = 0; j < n; ++ j)
+    {
+      for (i = L->offsets[j] + 1; i < L->offsets[j+1]; ++ i)
+        x[j] -= L->values[i]*x[L->indicies[i]];
+      x[j] /= L->values[L->offsets[j]];
+    }
+    /* backward substitution L^T*x = y, columns of L^T are rows of L */
+    for (j = n-1; j >= 0; -- j)
+    {
+      x[j] /= L->values[L->offsets[j]];
+      for (i = L->offsets[j] + 1; i < L->offsets[j+1]; ++ i)
+        x[L->indicies[i]] -= L->values[i]*x[j];
+    }
+  }
+}
+
+/* Deallocate numeric Cholesky factor if any */
+static void solver_chol_factor_free(fea_solver_ptr solver)
+{
+  if (solver->chol_factor)
+  {
+    sp_matrix_yale_free(solver->chol_factor);
+    free(solver->chol_factor);
+    solver->chol_factor = (sp_matrix_yale_ptr)0;
+  }
+}
+
+/*
+ * Create the Yale representation of the global stiffness matrix
+ * symmetrically permuted with solver->chol_perm: row/column i of the
+ * result is row/column chol_perm[i] of the global matrix
+ */
+static void solver_permuted_yale_init(fea_solver_ptr solver,
+                                      sp_matrix_yale_ptr mtx)
+{
+  int i,j,k,p,tmp;
+  int n = solver->global_mtx.rows_count;
+  int* iperm = (int*)malloc(sizeof(int)*n);
+  indexed_array* array;
+  real value;
+  for (i = 0; i < n; ++ i)
+    iperm[solver->chol_perm[i]] = i;
+  mtx->rows_count = mtx->cols_count = n;
+  mtx->storage_type = solver->global_mtx.storage_type;
+  mtx->offsets = (int*)malloc(sizeof(int)*(n+1));
+  mtx->offsets[0] = 0;
+  for (i = 0; i < n; ++ i)
+    mtx->offsets[i+1] = mtx->offsets[i] +
+      solver->global_mtx.storage[solver->chol_perm[i]].last_index + 1;
+  mtx->nnz = mtx->offsets[n];
+  mtx->indicies = (int*)malloc(sizeof(int)*mtx->nnz);
+  mtx->values = (real*)malloc(sizeof(real)*mtx->nnz);
+  for (i = 0; i < n; ++ i)
+  {
+    array = &solver->global_mtx.storage[solver->chol_perm[i]];
+    /* insertion sort of the renumbered indexes, rows are short */
+    for (j = 0, p = mtx->offsets[i]; j <= array->last_index; ++ j, ++ p)
+    {
+      tmp = iperm[array->indexes[j]];
+      value = array->values[j];
+      for (k = p; k > mtx->offsets[i] && mtx->indicies[k-1] > tmp; -- k)
+      {
+        mtx->indicies[k] = mtx->indicies[k-1];
+        mtx->values[k] = mtx->values[k-1];
+      }
+      mtx->indicies[k] = tmp;
+      mtx->values[k] = value;
+    }
+  }
+  free(iperm);
+}
+
 static BOOL solver_solve_slae_cholesky(fea_solver_ptr solver,
-                                       sp_matrix_yale_ptr mtx)
+                                       real* b, real* x)
 {
-  if (!solver->symb_chol)
+  sp_matrix_yale mtx;
+  int i;
+  int n = solver->global_mtx.rows_count;
+  real *pb,*px;
+  BOOL factorized;
+  /*
+   * numeric factorization is performed only if the global
+   * stiffness matrix has changed since the last solution
+   */
+  if (!solver->chol_factor)
   {
-    solver->symb_chol = calloc(1,sizeof(sp_chol_symbolic));
-    if (!sp_matrix_yale_chol_symbolic(mtx,solver->symb_chol))
-      error("Unable to create symbolic Cholesky decomposition\n");
+    /* ordering and symbolic decomposition depend on the mesh only */
+    if (!solver->symb_chol)
+      solver_create_ordering(solver);
+    if (solver->chol_perm)
+      solver_permuted_yale_init(solver,&mtx);
+    else
+      sp_matrix_yale_init(&mtx,&solver->global_mtx);
+    if (!solver->symb_chol)
+    {
+      solver->symb_chol = calloc(1,sizeof(sp_chol_symbolic));
+      if (!sp_matrix_yale_chol_symbolic(&mtx,solver->symb_chol))
+        error("Unable to create symbolic Cholesky decomposition\n");
+    }
+    solver->chol_factor = calloc(1,sizeof(sp_matrix_yale));
+    factorized = sp_matrix_yale_chol_numeric(&mtx,
+                                             solver->symb_chol,
+                                             solver->chol_factor);
+    if (solver->chol_perm)
+    {
+      free(mtx.offsets);
+      free(mtx.indicies);
+      free(mtx.values);
+    }
+    else
+      sp_matrix_yale_free(&mtx);
+    /* the tangent is not positive definite, i.e. the load step is too large */
+    if (!factorized)
+    {
+      LOGERROR("Unable to create numeric Cholesky decomposition");
+      solver_chol_factor_free(solver);
+      return FALSE;
+    }
+    LOGINFO("Cholesky factorization done");
+  }
+  if (solver->chol_perm)
+  {
+    /* solve P*K*P^T * (P*x) = P*b */
+    pb = (real*)malloc(sizeof(real)*n);
+    px = (real*)malloc(sizeof(real)*n);
+    for (i = 0; i < n; ++ i)
+      pb[i] = b[solver->chol_perm[i]];
+    solver_chol_factor_solve(solver->chol_factor,pb,px);
+    for (i = 0; i < n; ++ i)
+      x[solver->chol_perm[i]] = px[i];
+    free(px);
+    free(pb);
   }
-  if (!sp_matrix_yale_chol_symbolic_solve(mtx,
-                                          solver->symb_chol,
-                                          solver->global_forces_vct,
-                                          solver->global_solution_vct))
-    error("Unable to solve SLAE using Cholesky decomposition");
+  else
+    solver_chol_factor_solve(solver->chol_factor,b,x);
   LOGINFO("SLAE solved");
   return TRUE;  
 }
 
+/*
+ * Create the graph of nodes connected by elements in the compressed
+ * form: neighbors of the node i are adj[xadj[i]..xadj[i+1]-1]
+ */
+static void solver_create_nodes_graph(fea_solver_ptr self,
+                                      int** xadj_ptr, int** adj_ptr)
+{
+  int i,j,k,a,el,node,count;
+  int nodes_count = self->nodes0_p->nodes_count;
+  int nelem = self->fea_params_p->nodes_per_element;
+  int elnum = self->elements_p->elements_count;
+  int* node_elements_offsets = (int*)calloc(nodes_count+1,sizeof(int));
+  int* node_elements = (int*)malloc(sizeof(int)*elnum*nelem);
+  int* mark = (int*)malloc(sizeof(int)*nodes_count);
+  int* xadj = (int*)malloc(sizeof(int)*(nodes_count+1));
+  int* adj;
+
+  /* elements containing every node */
+  for (el = 0; el < elnum; ++ el)
+    for (a = 0; a < nelem; ++ a)
+      node_elements_offsets[self->elements_p->elements[el][a]+1] ++;
+  for (i = 0; i < nodes_count; ++ i)
+    node_elements_offsets[i+1] += node_elements_offsets[i];
+  for (el = 0; el < elnum; ++ el)
+    for (a = 0; a < nelem; ++ a)
+    {
+      node = self->elements_p->elements[el][a];
+      node_elements[node_elements_offsets[node]++] = el;
+    }
+  for (i = nodes_count; i > 0; -- i)
+    node_elements_offsets[i] = node_elements_offsets[i-1];
+  node_elements_offsets[0] = 0;
+
+  /* two passes: count neighbors, then fill them */
+  adj = (int*)0;
+  for (k = 0; k < 2; ++ k)
+  {
+    for (i = 0; i < nodes_count; ++ i)
+      mark[i] = -1;
+    count = 0;
+    for (i = 0; i < nodes_count; ++ i)
+    {
+      xadj[i] = count;
+      mark[i] = i;
+      for (j = node_elements_offsets[i]; j < node_elements_offsets[i+1]; ++ j)
+        for (a = 0; a < nelem; ++ a)
+        {
+          node = self->elements_p->elements[node_elements[j]][a];
+          if (mark[node] != i)
+          {
+            mark[node] = i;
+            if (adj)
+              adj[count] = node;
+            count ++;
+          }
+        }
+    }
+    xadj[nodes_count] = count;
+    if (!adj)
+      adj = (int*)malloc(sizeof(int)*(count > 0 ? count : 1));
+  }
+  free(mark);
+  free(node_elements);
+  free(node_elements_offsets);
+  *xadj_ptr = xadj;
+  *adj_ptr = adj;
+}
+
+void solver_create_ordering(fea_solver_ptr self)
+{
+  int i,j,k,index;
+  int dof = self->task_p->dof;
+  int nodes_count = self->nodes0_p->nodes_count;
+  int* xadj;
+  int* adj;
+  int* nodes_perm;
+
+  free(self->chol_perm);
+  self->chol_perm = (int*)0;
+  if (self->task_p->ordering == ORDERING_NONE)
+    return;
+  solver_create_nodes_graph(self,&xadj,&adj);
+  nodes_perm = (int*)malloc(sizeof(int)*nodes_count);
+  switch (self->task_p->ordering)
+  {
+  case ORDERING_MINIMUM_DEGREE:
+    ordering_minimum_degree(nodes_count,xadj,adj,nodes_perm);
+    break;
+  case ORDERING_NESTED_DISSECTION:
+    ordering_nested_dissection(nodes_count,xadj,adj,
+                               self->nodes0_p->nodes,nodes_perm);
+    break;
+  case ORDERING_NONE:
+  default:
+    for (i = 0; i < nodes_count; ++ i)
+      nodes_perm[i] = i;
+  }
+  /* expand permutation of nodes to equations of their d.o.f. */
+  self->chol_perm = (int*)malloc(sizeof(int)*self->equations_count);
+  k = 0;
+  for (i = 0; i < nodes_count; ++ i)
+    for (j = 0; j < dof; ++ j)
+    {
+      index = self->equations[nodes_perm[i]*dof + j];
+      if (index >= 0)
+        self->chol_perm[k++] = index;
+    }
+  LOGINFO("Fill-reducing ordering created");
+  free(nodes_perm);
+  free(adj);
+  free(xadj);
+}
+
 BOOL solver_solve_slae(fea_solver_ptr solver)
 {
   BOOL result = FALSE;
   sp_matrix_yale mtx;
-  sp_matrix_yale_init(&mtx,&solver->global_mtx);
+  int i;
+  int size = solver->nodes_p->nodes_count*solver->task_p->dof;
+  real* b = solver->global_forces_vct;
+  real* x = solver->global_solution_vct;
+
+  /* block storage and matrix-free operator are solved for all d.o.f. */
+  if (solver->block_storage)
+    return solver_solve_slae_block(solver);
+  if (solver->task_p->matrix_free)
+    return solver_solve_slae_all_dof(solver,
+                                     solver_element_operator,solver,
+                                     solver->node_blocks ?
+                                     solver_node_blocks_prec :
+                                     (linear_operator_t)0,
+                                     solver);
+  /*
+   * with eliminated prescribed d.o.f. the system is solved for
+   * the free equations only, prescribed d.o.f. get zero increments
+   */
+  if (solver->equations_count != size)
+  {
+    b = (real*)malloc(sizeof(real)*solver->equations_count);
+    x = (real*)malloc(sizeof(real)*solver->equations_count);
+    for (i = 0; i < size; ++ i)
+      if (solver->equations[i] >= 0)
+        b[solver->equations[i]] = solver->global_forces_vct[i];
+  }
 
   LOGINFO("Preparing to solve SLAE"); 
+  if (solver->task_p->solver_type == CHOLESKY)
+  {
+    /* direct solver keeps its own factorization of the matrix */
+    result = solver_solve_slae_cholesky(solver,b,x);
+  }
+  else
+  {
+    sp_matrix_yale_init(&mtx,&solver->global_mtx);
 #if 0
-  sp_matrix_yale_save_file(&mtx,"fea_matrix.mtx");
-  exit(1);
+    sp_matrix_yale_save_file(&mtx,"fea_matrix.mtx");
+    exit(1);
 #endif
-  LOGINFO("Starting to solve SLAE");
-  if (solver->task_p->solver_type == CHOLESKY)
-    result = solver_solve_slae_cholesky(solver,&mtx);
-  else if (solver->task_p->solver_type == CG)
-    result = solver_solve_slae_cg(solver,&mtx);
-  else if (solver->task_p->solver_type == PCG_ILU)
-    result = solver_solve_slae_pcg_ilu(solver,&mtx);
+    LOGINFO("Starting to solve SLAE");
+    if (solver->task_p->solver_type == CG)
+      result = solver_solve_slae_cg(solver,&mtx,b,x);
+    else if (solver->task_p->solver_type == PCG_ILU)
+      result = solver_solve_slae_pcg_ilu(solver,&mtx,b,x);
+    else if (solver->task_p->solver_type == PCG_AMG)
+      result = solver_solve_slae_pcg_amg(solver,&mtx,b,x);
+    sp_matrix_yale_free(&mtx);
+  }
 
-  sp_matrix_yale_free(&mtx);
+  if (solver->equations_count != size)
+  {
+    for (i = 0; i < size; ++ i)
+      solver->global_solution_vct[i] =
+        solver->equations[i] >= 0 ? x[solver->equations[i]] : 0;
+    free(x);
+    free(b);
+  }
   return result;
 }
 
 
-int parse_cmdargs(int argc, char **argv,char **filename)
+int parse_cmdargs(int argc, char **argv,char **filename, int* format,
+                  char **convert)
 {
-  if (argc < 2)
+  int i;
+  *filename = 0;
+  *format = -1;
+  *convert = 0;
+  for (i = 1; i < argc; ++ i)
   {
-    printf("Usage: fea_solve input_data.sexp\n");
+    if (!strcmp(argv[i],"-b") || !strcmp(argv[i],"--binary"))
+      *format = EXPORT_GMSH_BINARY;
+    else if (!strcmp(argv[i],"-a") || !strcmp(argv[i],"--ascii"))
+      *format = EXPORT_GMSH_ASCII;
+    else if ((!strcmp(argv[i],"-c") || !strcmp(argv[i],"--convert")) &&
+             i + 1 < argc)
+      *convert = argv[++i];
+    else
+      *filename = argv[i];
+  }
+  if (!*filename)
+  {
+    printf("Usage: fea_solve [-a|--ascii|-b|--binary] "
+           "input_data.sexp|input_data.ftask\n"
+           "       fea_solve -c|--convert output.ftask input_data.sexp\n");
     return 1;
   }
-  *filename = argv[1];
   return 0;
 }
 
@@ -390,7 +1545,7 @@ fea_solver* fea_solver_alloc(fea_task_ptr task,
                            elements_array_ptr elements,
                            presc_bnd_array_ptr prs_boundary)
 {
-  int msize,bandwidth,elnum,gauss_count,i,j,k,l;
+  int msize,bandwidth,elnum,gauss_count;
   /* Allocate structure */
   fea_solver_ptr solver = (fea_solver_ptr)malloc(sizeof(fea_solver));
   /* Copy pointers to the solver structure */
@@ -402,6 +1557,7 @@ fea_solver* fea_solver_alloc(fea_task_ptr task,
   solver->presc_boundary_p = prs_boundary;
 
   solver->elements_db.gauss_nodes = (gauss_node**)0;
+  solver->shape_gradients_func = solver_shape_gradients_generic;
   solver_create_element_params(solver);
   fea_model_init(&solver->task_p->model, solver->task_p->model.model);
   
@@ -410,44 +1566,82 @@ fea_solver* fea_solver_alloc(fea_task_ptr task,
   elnum = elements->elements_count;
   gauss_count = solver->fea_params_p->gauss_nodes_count;
   solver->shape_gradients0 =
-    (shape_gradients***)malloc(sizeof(shape_gradients_ptr*)*elnum);
+    (shape_gradients_ptr)calloc(elnum*gauss_count,sizeof(shape_gradients));
   solver->shape_gradients  =
-    (shape_gradients***)malloc(sizeof(shape_gradients_ptr*)*elnum);
-  solver->stresses = (tensor**)malloc(sizeof(tensor*)*elnum);
-  solver->graddefs = (tensor**)malloc(sizeof(tensor*)*elnum);
-  for (i = 0; i < elnum; ++ i)
-  {
-    solver->stresses[i] = (tensor*)malloc(sizeof(tensor)*gauss_count);
-    solver->graddefs[i] = (tensor*)malloc(sizeof(tensor)*gauss_count);
-    solver->shape_gradients0[i] =
-      (shape_gradients**)malloc(sizeof(shape_gradients_ptr)*gauss_count);
-    solver->shape_gradients[i] =
-      (shape_gradients**)malloc(sizeof(shape_gradients_ptr)*gauss_count);
-    
-    for (j = 0; j < gauss_count; ++ j)
-    {
-      solver->shape_gradients0[i][j] = (shape_gradients_ptr)0;
-      solver->shape_gradients[i][j] = (shape_gradients_ptr)0;
-      for ( k = 0; k < MAX_DOF; ++ k)
-        for (l = 0; l < MAX_DOF; ++ l)
-        {
-          solver->stresses[i][j].components[k][l] = 0.0;
-          solver->graddefs[i][j].components[k][l] = 0.0;
-        }
-    }
-  }
+    (shape_gradients_ptr)calloc(elnum*gauss_count,sizeof(shape_gradients));
+  solver->stresses = (tensor*)calloc(elnum*gauss_count,sizeof(tensor));
+  solver->graddefs = (tensor*)calloc(elnum*gauss_count,sizeof(tensor));
   solver->current_load_step = 0;
   solver->load_steps_p = (load_step_ptr)malloc(sizeof(load_step)*
-                                               task->load_increments_count);
+                                               LOAD_STEPS_HISTORY);
+  solver->export_stream = (FILE*)0;
+  solver->export_queue = (export_queue_ptr)0;
   /* allocate resources initialize global stiffness matrix */
-  /* global matrix size */
-  msize = nodes->nodes_count*solver->task_p->dof;
+  /* global matrix size is the number of equations */
+  solver_create_equations(solver);
+  msize = solver->equations_count;
   /* approximate bandwidth of a global matrix
    * usually sqrt(msize)*2*/
   bandwidth = (int)sqrt(msize)*2;
-  sp_matrix_init(&solver->global_mtx,msize,msize,bandwidth,CCS);
+  /*
+   * CG and PCG_AMG use only matrix-vector products, so the matrix
+   * is stored by 3x3 blocks of nodes with one index per block
+   */
+  solver->block_storage = !task->matrix_free &&
+    (task->solver_type == CG || task->solver_type == PCG_AMG) &&
+    task->dof == BSR_BLOCK_SIZE;
+  memset(&solver->global_bsr,0,sizeof(bsr_matrix));
+  memset(&solver->global_mtx,0,sizeof(sp_matrix));
+  if (!solver->block_storage && !task->matrix_free)
+    sp_matrix_init(&solver->global_mtx,msize,msize,bandwidth,CCS);
+  /* matrix-free operator keeps material tangents instead of the matrix */
+  solver->tangents = (real(*)[VOIGT_SIZE][VOIGT_SIZE])0;
+  solver->node_blocks = (real(*)[MAX_DOF*MAX_DOF])0;
+  if (task->matrix_free)
+  {
+    solver->tangents = (real(*)[VOIGT_SIZE][VOIGT_SIZE])
+      malloc(sizeof(real)*VOIGT_SIZE*VOIGT_SIZE*elnum*gauss_count);
+    if (task->preconditioner != PRECONDITIONER_NONE)
+      solver->node_blocks = (real(*)[MAX_DOF*MAX_DOF])
+        malloc(sizeof(real)*MAX_DOF*MAX_DOF*nodes->nodes_count);
+  }
   solver->symb_chol = 0;
-  /* allocate memory for global forces and solution vectors */
+  solver->chol_factor = (sp_matrix_yale_ptr)0;
+  solver->chol_perm = (int*)0;
+  solver->ilu = (sp_matrix_skyline_ilu_ptr)0;
+  solver->amg = (amg_hierarchy_ptr)0;
+  solver->ilu_solves = 0;
+  solver->ilu_base_iter = 0;
+  solver->ilu_base_tolerance = 0;
+  solver->stiffness_map = (int*)0;
+  /* secant updates need the kept global matrix */
+  solver->bfgs_s = (real*)0;
+  solver->bfgs_y = (real*)0;
+  solver->bfgs_rho = (real*)0;
+  solver->bfgs_alpha = (real*)0;
+  solver->bfgs_forces = (real*)0;
+  solver->bfgs_count = 0;
+  solver->forcing_term = 0;
+  solver->residual_norm = 0;
+  if (task->bfgs_max > 0 && !task->matrix_free)
+  {
+    msize = nodes->nodes_count*solver->task_p->dof;
+    solver->bfgs_s = (real*)malloc(sizeof(real)*msize*task->bfgs_max);
+    solver->bfgs_y = (real*)malloc(sizeof(real)*msize*task->bfgs_max);
+    solver->bfgs_rho = (real*)malloc(sizeof(real)*task->bfgs_max);
+    solver->bfgs_alpha = (real*)malloc(sizeof(real)*task->bfgs_max);
+    solver->bfgs_forces = (real*)malloc(sizeof(real)*msize);
+  }
+  /* partition elements into the sets without shared nodes */
+  solver_create_elements_colors(solver);
+#ifdef _OPENMP
+  if (task->threads_count > 0)
+    omp_set_num_threads(task->threads_count);
+  LOG("Using %d threads",omp_get_max_threads());
+#endif
+  /* allocate memory for global forces and solution vectors
+   * for all d.o.f. including prescribed */
+  msize = nodes->nodes_count*solver->task_p->dof;
   solver->global_forces_vct = (real*)malloc(sizeof(real)*msize);
   solver->global_solution_vct = (real*)malloc(sizeof(real)*msize);
   memset(solver->global_forces_vct,0,sizeof(real)*msize);
@@ -460,32 +1654,24 @@ fea_solver_ptr fea_solver_free(fea_solver_ptr solver)
 {
   /* deallocate resources */
   /* free shape gradients, graddefs and stresses */
-  int elnum = solver->elements_p->elements_count;
-  int gauss_count = solver->fea_params_p->gauss_nodes_count;
-  int i,j;
-  for (i = 0; i < elnum; ++ i)
-  {
-    for (j = 0; j < gauss_count; ++ j)
-    {
-      if (solver->shape_gradients0[i][j])
-        solver_shape_gradients_free(solver,solver->shape_gradients0[i][j]);
-      if (solver->shape_gradients[i][j])
-        solver_shape_gradients_free(solver,solver->shape_gradients[i][j]);
-    }
-    free(solver->shape_gradients0[i]);
-    free(solver->shape_gradients[i]);
-    free(solver->stresses[i]);
-    free(solver->graddefs[i]);
-  }
+  int i;
+  /* the writer thread uses the mesh, finish it first */
+  solver->export_queue = export_queue_free(solver->export_queue);
   free(solver->shape_gradients0);
-  free(solver->shape_gradients);  
+  free(solver->shape_gradients);
   free(solver->stresses);
   free(solver->graddefs);
   /* free stored load steps */
-  for ( i = 0; i < solver->current_load_step; ++ i)
+  for ( i = 0; i < solver->current_load_step && i < LOAD_STEPS_HISTORY; ++ i)
     solver_load_step_free(solver, &solver->load_steps_p[i]);
   free(solver->load_steps_p);
+  if (solver->export_stream)
+    fclose(solver->export_stream);
   /* deallocate all other resources */
+  if (solver->block_storage)
+    bsr_matrix_free(&solver->global_bsr);
+  else if (!solver->task_p->matrix_free)
+    sp_matrix_free(&solver->global_mtx);
   solver_free_element_database(solver);
   fea_task_free(solver->task_p);
   fea_solution_params_free(solver->fea_params_p);
@@ -493,7 +1679,21 @@ fea_solver_ptr fea_solver_free(fea_solver_ptr solver)
   nodes_array_free(solver->nodes_p);
   elements_array_free(solver->elements_p);
   presc_bnd_array_free(solver->presc_boundary_p);
-  sp_matrix_free(&solver->global_mtx);
+  free(solver->tangents);
+  free(solver->node_blocks);
+  free(solver->bfgs_s);
+  free(solver->bfgs_y);
+  free(solver->bfgs_rho);
+  free(solver->bfgs_alpha);
+  free(solver->bfgs_forces);
+  solver_chol_factor_free(solver);
+  free(solver->chol_perm);
+  solver_ilu_free(solver);
+  amg_free(solver->amg);
+  free(solver->stiffness_map);
+  free(solver->equations);
+  free(solver->colors_offsets);
+  free(solver->colored_elements);
   free(solver->global_forces_vct);
   free(solver->global_solution_vct);
   free(solver);
@@ -555,7 +1755,7 @@ gauss_node_ptr solver_gauss_node_free(fea_solver_ptr self,
 
 void solver_create_element_database(fea_solver_ptr self)
 {
-  int gauss;
+  int gauss,i;
   int gauss_count = self->fea_params_p->gauss_nodes_count;
   /* Create database only if not created yet */
   if (!self->elements_db.gauss_nodes)
@@ -566,7 +1766,15 @@ void solver_create_element_database(fea_solver_ptr self)
     for (gauss = 0; gauss < gauss_count; ++ gauss)
       self->elements_db.gauss_nodes[gauss] =
         solver_gauss_node_alloc(self,gauss);
-    
+    /* copy derivatives to the table with compile-time sizes */
+    if (self->task_p->ele_type == TETRAHEDRA10)
+    {
+      for (gauss = 0; gauss < gauss_count; ++ gauss)
+        for (i = 0; i < MAX_DOF; ++ i)
+          memcpy(self->elements_db.tetrahedra10_dforms[gauss][i],
+                 self->elements_db.gauss_nodes[gauss]->dforms[i],
+                 sizeof(real)*TETRAHEDRA10_NODES);
+    }
   }
 }
 
@@ -606,46 +1814,34 @@ void solver_load_step_init(fea_solver_ptr self,
                     load_step_ptr step,
                     int step_number)
 {
-  int elnum = self->elements_p->elements_count;
-  int gauss_count = self->fea_params_p->gauss_nodes_count;
-  int i,j,k,l;
+  int size = self->elements_p->elements_count*
+    self->fea_params_p->gauss_nodes_count;
   if (step)
   {
     step->step_number = step_number;
     step->nodes_p = nodes_array_copy_alloc(self->nodes_p);
-    step->stresses = (tensor**)malloc(sizeof(tensor*)*elnum);
-    step->graddefs = (tensor**)malloc(sizeof(tensor*)*elnum);
-
-    for (i = 0; i < elnum; ++ i)
-    {
-      step->stresses[i] = (tensor*)malloc(sizeof(tensor)*gauss_count);
-      step->graddefs[i] = (tensor*)malloc(sizeof(tensor)*gauss_count);    
-      for (j = 0; j < gauss_count; ++ j)
-      {
-        for ( k = 0; k < MAX_DOF; ++ k)
-          for (l = 0; l < MAX_DOF; ++ l)
-          {
-            step->stresses[i][j].components[k][l] =
-              self->stresses[i][j].components[k][l];
-            step->graddefs[i][j].components[k][l] =
-              self->graddefs[i][j].components[k][l];
-          }
-      }
-    }
+    /* stresses and graddefs are stored in contiguous arrays */
+    step->stresses = (tensor*)malloc(sizeof(tensor)*size);
+    step->graddefs = (tensor*)malloc(sizeof(tensor)*size);
+    memcpy(step->stresses,self->stresses,sizeof(tensor)*size);
+    memcpy(step->graddefs,self->graddefs,sizeof(tensor)*size);
   }
 }
 
+load_step_ptr solver_load_step(fea_solver_ptr self, int step)
+{
+  if (step < 0 || step >= self->current_load_step ||
+      step < self->current_load_step - LOAD_STEPS_HISTORY)
+    return (load_step_ptr)0;
+  return &self->load_steps_p[step % LOAD_STEPS_HISTORY];
+}
+
 void solver_load_step_free(fea_solver_ptr self, load_step_ptr step)
 {
-  int elnum = self->elements_p->elements_count;
-  int i;
+  /* all arrays of the step are contiguous, sizes are not needed */
+  (void)self;
   if (step)
   {
-    for (i = 0; i < elnum; ++ i)
-    {
-      free(step->stresses[i]);
-      free(step->graddefs[i]);
-    }
     free(step->stresses);
     free(step->graddefs);
     nodes_array_free(step->nodes_p);
@@ -653,18 +1849,29 @@ void solver_load_step_free(fea_solver_ptr self, load_step_ptr step)
 }
 
 
-shape_gradients_ptr solver_shape_gradients_alloc(fea_solver_ptr self,
-                                               nodes_array_ptr nodes,
-                                               int element,
-                                               int gauss)
+shape_gradients_ptr solver_shape_gradients(fea_solver_ptr self,
+                                           BOOL current,
+                                           int element,
+                                           int gauss)
+{
+  int index = element*self->fea_params_p->gauss_nodes_count + gauss;
+  return current ? &self->shape_gradients[index] :
+    &self->shape_gradients0[index];
+}
+
+BOOL solver_shape_gradients_generic(fea_solver_ptr self,
+                                    nodes_array_ptr nodes,
+                                    int element,
+                                    int gauss,
+                                    real (*grads)[MAX_NODES_PER_ELEMENT],
+                                    real* detJ)
 {
   int i,j,k;
-  int row_size;
-  real detJ;
+  int nelem = self->fea_params_p->nodes_per_element;
+  real** dforms = self->elements_db.gauss_nodes[gauss]->dforms;
   /* J is a Jacobi matrix of transformation btw local and global */
   /* coordinate systems */
   real J[MAX_DOF][MAX_DOF];
-  shape_gradients_ptr grads = (shape_gradients_ptr)0;
 
   /* Fill an array using Bonet & Wood 7.6(a,b) p.198, 1st edition */
   /* also see Zienkiewitz v1, 6th edition, p.146-147 */
@@ -690,53 +1897,27 @@ shape_gradients_ptr solver_shape_gradients_alloc(fea_solver_ptr self,
   for (i = 0; i < MAX_DOF; ++ i)
     for (j = 0; j < MAX_DOF; ++ j)
     {
-      for (k = 0; k < self->fea_params_p->nodes_per_element; ++ k)
-        J[i][j] += self->elements_db.gauss_nodes[gauss]->dforms[i][k]* \
-          solver_node_dof(self,nodes,element,k,j);
+      for (k = 0; k < nelem; ++ k)
+        J[i][j] += dforms[i][k]*solver_node_dof(self,nodes,element,k,j);
     }
-  if (inv3x3(J,&detJ))                /* inverse exists */
-  {
-    /* Allocate memory for shape gradients */
-    grads = (shape_gradients_ptr)malloc(sizeof(shape_gradients));
-    grads->grads = (real**)malloc(sizeof(real*)*(self->task_p->dof));
-    row_size = sizeof(real)*(self->fea_params_p->nodes_per_element);
-    for (i = 0; i < self->task_p->dof; ++ i)
+  if (!inv3x3(J,detJ))                /* inverse doesn't exist */
+    return FALSE;
+    
+  /* [ dN/dx ]           [ dN/dr ] */
+  /* [ dN/dy ]  = J^-1 * [ dN/ds ] */
+  /* [ dN/dz ]           [ dN/dt ] */
+  for ( i = 0; i < MAX_DOF; ++ i)
+    for ( j = 0; j < nelem; ++ j)
     {
-      grads->grads[i] = (real*)malloc(row_size);
-      memset(grads->grads[i],0,row_size);
+      grads[i][j] = 0;
+      for ( k = 0; k < MAX_DOF; ++ k)
+        grads[i][j] += J[i][k]*dforms[k][j];
     }
-    /* Store determinant of the Jacobi matrix */
-    grads->detJ = detJ;
-    
-    /* [ dN/dx ]           [ dN/dr ] */
-    /* [ dN/dy ]  = J^-1 * [ dN/ds ] */
-    /* [ dN/dz ]           [ dN/dt ] */
-    for ( i = 0; i < MAX_DOF; ++ i)
-      for ( j = 0; j < self->fea_params_p->nodes_per_element; ++ j)
-        for ( k = 0; k < MAX_DOF; ++ k)
-          grads->grads[i][j] += J[i][k]* \
-            self->elements_db.gauss_nodes[gauss]->dforms[k][j];
-  }
-
-  return grads;
-}
-
-/* Destructor for the shape gradients array */
-shape_gradients_ptr solver_shape_gradients_free(fea_solver_ptr self,
-                                                shape_gradients_ptr grads)
-{
-  int i;
-  /* for (i = 0; i < self->fea_params->nodes_per_element; ++ i */
-  for (i = 0; i < self->task_p->dof; ++ i)
-    free(grads->grads[i]);
-  free(grads->grads);
-  grads->grads = (real**)0;
-  free(grads);
-  return (shape_gradients_ptr)0;
+  return TRUE;
 }
 
 #ifdef DUMP_DATA
-void solver_dump_local_stiffness(fea_solver* self,real **stiff,int el)
+void solver_dump_local_stiffness(fea_solver* self,real *stiff,int el)
 {
   int i,j;
   FILE* f;
@@ -748,7 +1929,7 @@ void solver_dump_local_stiffness(fea_solver* self,real **stiff,int el)
     for ( i = 0; i < size; ++ i)
     {
       for ( j = 0; j < size; ++ j)
-        fprintf(f,"%e ",stiff[i][j]);
+        fprintf(f,"%e ",stiff[i*size + j]);
       fprintf(f,"\n");
     }
     fclose(f);
@@ -789,8 +1970,11 @@ void solver_create_shape_gradients(fea_solver_ptr self,BOOL current)
   /* prepare an array of shape functions gradients in
    * gauss nodes per element */
   shape_gradients_ptr grads = (shape_gradients_ptr)0;
+  nodes_array_ptr nodes = current ? self->nodes_p : self->nodes0_p;
   int gauss,element;
+  real detJ;
   /* loop by elements */
+#pragma omp parallel for private(gauss,grads,detJ) schedule(static)
   for ( element = 0;
         element < self->elements_p->elements_count;
         ++ element)
@@ -800,29 +1984,15 @@ void solver_create_shape_gradients(fea_solver_ptr self,BOOL current)
          gauss < self->fea_params_p->gauss_nodes_count;
          ++ gauss)
     {
-      /* create shape gradients either in initial or current configuration */
-      grads = solver_shape_gradients_alloc(self,
-                                         current ?
-                                         self->nodes_p : self->nodes0_p,
-                                         element,gauss);
-      if (grads)
-      {
-        /* free previous shape gradients array */
-        if (current)            /* current configuration */
-        {
-          if ( self->shape_gradients[element][gauss] )
-            solver_shape_gradients_free(self,
-                                        self->shape_gradients[element][gauss]);
-          self->shape_gradients[element][gauss] = grads;
-        }
-        else                    /* initial configuration */
-        {
-          if ( self->shape_gradients0[element][gauss] )
-            solver_shape_gradients_free(self,
-                                        self->shape_gradients0[element][gauss]);
-          self->shape_gradients0[element][gauss] = grads;
-        }
-      }
+      /*
+       * calculate shape gradients either in initial or current
+       * configuration in place, previous values are kept if the
+       * Jacobi matrix is ill-formed
+       */
+      grads = solver_shape_gradients(self,current,element,gauss);
+      if (self->shape_gradients_func(self,nodes,element,gauss,
+                                     grads->grads,&detJ))
+        grads->detJ = detJ;
     }
   }
 }
@@ -833,238 +2003,556 @@ void solver_create_current_shape_gradients(fea_solver_ptr self)
   solver_create_shape_gradients(self,TRUE);
 }
 
-void solver_create_initial_shape_gradients(fea_solver_ptr self)
+void solver_create_initial_shape_gradients(fea_solver_ptr self)
+{
+  solver_create_shape_gradients(self,FALSE);
+}
+
+
+
+void solver_create_stresses(fea_solver_ptr self)
+{
+  int gauss,el,index;
+  int gauss_count = self->fea_params_p->gauss_nodes_count;
+  /* loop by elements, stresses in elements are independent */
+#pragma omp parallel for private(gauss,index) schedule(static)
+  for ( el = 0;
+        el < self->elements_p->elements_count;
+        ++ el)
+  {
+    /* loop by gauss nodes per element */
+    for (gauss = 0; gauss < gauss_count; ++ gauss)
+    {
+      index = el*gauss_count + gauss;
+      solver_element_gauss_stress(self, el, gauss,
+                                  self->graddefs[index].components,
+                                  self->stresses[index].components);
+    }
+  }
+}
+
+void solver_create_residual_forces(fea_solver_ptr self)
+{
+  int color,i;
+  memset(self->global_forces_vct,0,
+         sizeof(real)*self->nodes_p->nodes_count*self->task_p->dof);
+
+  /* elements of the same color do not share nodes */
+  for (color = 0; color < self->colors_count; ++ color)
+  {
+#pragma omp parallel for schedule(static)
+    for (i = self->colors_offsets[color];
+         i < self->colors_offsets[color+1]; ++ i)
+      solver_local_residual_forces(self, self->colored_elements[i]);
+  }
+}
+
+void solver_create_elements_colors(fea_solver_ptr self)
+{
+  int el,i,color,count;
+  BOOL free_color;
+  int elnum = self->elements_p->elements_count;
+  int nelem = self->fea_params_p->nodes_per_element;
+  /* the last color which was assigned to an element with this node */
+  int* node_color = (int*)malloc(sizeof(int)*self->nodes_p->nodes_count);
+  /* colors of elements */
+  int* colors = (int*)malloc(sizeof(int)*elnum);
+
+  for (i = 0; i < self->nodes_p->nodes_count; ++ i)
+    node_color[i] = -1;
+  for (el = 0; el < elnum; ++ el)
+    colors[el] = -1;
+  /*
+   * Greedy coloring: on every pass take all not yet colored elements
+   * which do not share nodes with elements already colored in the
+   * current color
+   */
+  count = 0;
+  for (color = 0; count < elnum; ++ color)
+  {
+    for (el = 0; el < elnum; ++ el)
+    {
+      if (colors[el] >= 0)
+        continue;
+      free_color = TRUE;
+      for (i = 0; i < nelem && free_color; ++ i)
+        free_color = node_color[self->elements_p->elements[el][i]] != color;
+      if (free_color)
+      {
+        colors[el] = color;
+        for (i = 0; i < nelem; ++ i)
+          node_color[self->elements_p->elements[el][i]] = color;
+        count ++;
+      }
+    }
+  }
+  self->colors_count = color;
+  /* sort elements by colors */
+  self->colors_offsets = (int*)calloc(color+1,sizeof(int));
+  self->colored_elements = (int*)malloc(sizeof(int)*elnum);
+  for (el = 0; el < elnum; ++ el)
+    self->colors_offsets[colors[el]+1] ++;
+  for (color = 0; color < self->colors_count; ++ color)
+    self->colors_offsets[color+1] += self->colors_offsets[color];
+  /* use node_color as a current position in the color */
+  for (color = 0; color < self->colors_count; ++ color)
+    node_color[color] = self->colors_offsets[color];
+  for (el = 0; el < elnum; ++ el)
+    self->colored_elements[node_color[colors[el]]++] = el;
+
+  free(colors);
+  free(node_color);
+  LOG("Elements partitioned into %d colors",self->colors_count);
+}
+
+/*
+ * Find the offset of the element (row,col) in the values array of the
+ * corresponding row/column of the ordered sparse matrix.
+ * Returns -1 if the element is not in the sparsity pattern
+ */
+static int solver_matrix_offset(sp_matrix_ptr mtx, int row, int col)
+{
+  indexed_array* array;
+  int index,low,high,middle;
+  if (mtx->storage_type == CCS)
+  {
+    array = &mtx->storage[col];
+    index = row;
+  }
+  else
+  {
+    array = &mtx->storage[row];
+    index = col;
+  }
+  /* binary search, indexes are sorted */
+  low = 0;
+  high = array->last_index;
+  while (low <= high)
+  {
+    middle = (low + high)/2;
+    if (array->indexes[middle] == index)
+      return middle;
+    if (array->indexes[middle] < index)
+      low = middle + 1;
+    else
+      high = middle - 1;
+  }
+  return -1;
+}
+
+void solver_create_stiffness_pattern(fea_solver_ptr self)
+{
+  int el,I,J,globalI,globalJ,offset;
+  int dof = self->task_p->dof;
+  int size = self->fea_params_p->nodes_per_element*dof;
+  int* map;
+  int* xadj;
+  int* adj;
+
+  if (self->block_storage)
+  {
+    /* blocks of nodes connected by elements */
+    solver_create_nodes_graph(self,&xadj,&adj);
+    bsr_matrix_init(&self->global_bsr,self->nodes0_p->nodes_count,xadj,adj);
+    free(adj);
+    free(xadj);
+  }
+  else
+  {
+    /* fill the sparsity pattern of the global matrix */
+    sp_matrix_clear(&self->global_mtx);
+    for (el = 0; el < self->elements_p->elements_count; ++ el)
+      for (I = 0; I < size; ++ I)
+      {
+        globalI =
+          self->equations[self->elements_p->elements[el][I/dof]*dof + I%dof];
+        if (globalI < 0)
+          continue;
+        for (J = 0; J < size; ++ J)
+        {
+          globalJ =
+            self->equations[self->elements_p->elements[el][J/dof]*dof + J%dof];
+          if (globalJ >= 0)
+            sp_matrix_element_add(&self->global_mtx,globalI,globalJ,1.0);
+        }
+      }
+    /* sort indexes in order to find offsets using binary search */
+    sp_matrix_reorder(&self->global_mtx);
+  }
+
+  /* record offsets of every element of local stiffness matrices */
+  self->stiffness_map = (int*)malloc(sizeof(int)*size*size*
+                                     self->elements_p->elements_count);
+  map = self->stiffness_map;
+  for (el = 0; el < self->elements_p->elements_count; ++ el)
+    for (I = 0; I < size; ++ I)
+    {
+      globalI = self->equations[self->elements_p->elements[el][I/dof]*dof +
+                                I%dof];
+      for (J = 0; J < size; ++ J)
+      {
+        globalJ = self->equations[self->elements_p->elements[el][J/dof]*dof +
+                                  J%dof];
+        /* components of eliminated prescribed d.o.f. are skipped */
+        if (globalI < 0 || globalJ < 0)
+        {
+          *map++ = -1;
+          continue;
+        }
+        if (self->block_storage)
+        {
+          /* offset of the component in the values of all blocks */
+          offset = bsr_matrix_block(&self->global_bsr,
+                                    self->elements_p->elements[el][I/dof],
+                                    self->elements_p->elements[el][J/dof]);
+          if (offset >= 0)
+            offset = offset*BSR_BLOCK_SQR + (I%dof)*BSR_BLOCK_SIZE + J%dof;
+        }
+        else
+          offset = solver_matrix_offset(&self->global_mtx,globalI,globalJ);
+        if (offset < 0)
+          error("solver_create_stiffness_pattern: broken sparsity pattern");
+        *map++ = offset;
+      }
+    }
+  LOG("Sparsity pattern created");
+}
+
+/* Set to zero all values of the global stiffness keeping its pattern */
+static void solver_clear_stiffness(fea_solver_ptr self)
 {
-  solver_create_shape_gradients(self,FALSE);
+  int i;
+  int count = self->global_mtx.storage_type == CCS ?
+    self->global_mtx.cols_count : self->global_mtx.rows_count;
+  if (self->block_storage)
+  {
+    bsr_matrix_clear(&self->global_bsr);
+    return;
+  }
+  for (i = 0; i < count; ++ i)
+    memset(self->global_mtx.storage[i].values,0,
+           sizeof(real)*(self->global_mtx.storage[i].last_index+1));
 }
 
-
-
-void solver_create_stresses(fea_solver_ptr self)
+/*
+ * Store material tangents in gauss nodes of the element for the
+ * matrix-free operator and add diagonal blocks [K_aa] of the local
+ * stiffness to node_blocks if any
+ */
+static void solver_local_tangents(fea_solver_ptr self, int element)
 {
-  int gauss,el;
-  /* loop by elements */
-  for ( el = 0;
-        el < self->elements_p->elements_count;
-        ++ el)
+  shape_gradients_ptr grads;
+  int gauss,a,r,i,j,k,l;
+  int dof = self->task_p->dof;
+  int nelem = self->fea_params_p->nodes_per_element;
+  int gauss_count = self->fea_params_p->gauss_nodes_count;
+  tensor_ptr graddefs = self->graddefs + element*gauss_count;
+  tensor_ptr stresses = self->stresses + element*gauss_count;
+  real (*D)[VOIGT_SIZE];
+  real (*stress)[MAX_DOF];
+  real DB[VOIGT_SIZE][MAX_DOF];
+  real ga[MAX_DOF];
+  real* block;
+  real volume,saa,kij;
+
+  for (gauss = 0; gauss < gauss_count; ++ gauss)
   {
-    /* loop by gauss nodes per element */
-    for (gauss = 0;
-         gauss < self->fea_params_p->gauss_nodes_count;
-         ++ gauss)
+    grads = solver_shape_gradients(self,TRUE,element,gauss);
+    D = self->tangents[element*gauss_count + gauss];
+    self->task_p->model.ctensor_voigt(&self->task_p->model,
+                                      graddefs[gauss].components,
+                                      D);
+    if (!self->node_blocks)
+      continue;
+    stress = stresses[gauss].components;
+    volume = fabs(grads->detJ)*self->elements_db.gauss_nodes[gauss]->weight;
+    for (a = 0; a < nelem; ++ a)
     {
-      solver_element_gauss_stress(self, el, gauss,
-                                  self->graddefs[el][gauss].components,
-                                  self->stresses[el][gauss].components);
+      ga[0] = grads->grads[0][a];
+      ga[1] = grads->grads[1][a];
+      ga[2] = grads->grads[2][a];
+      /* [K_aa] = B_a^T D B_a + initial stress, see solver_local_stiffness */
+      for (r = 0; r < VOIGT_SIZE; ++ r)
+      {
+        DB[r][0] = D[r][0]*ga[0] + D[r][3]*ga[1] + D[r][5]*ga[2];
+        DB[r][1] = D[r][1]*ga[1] + D[r][3]*ga[0] + D[r][4]*ga[2];
+        DB[r][2] = D[r][2]*ga[2] + D[r][4]*ga[1] + D[r][5]*ga[0];
+      }
+      saa = 0;
+      for (k = 0; k < dof; ++ k)
+        for (l = 0; l < dof; ++ l)
+          saa += ga[k]*stress[k][l]*ga[l];
+      block = self->node_blocks[self->elements_p->elements[element][a]];
+      for (j = 0; j < dof; ++ j)
+        for (i = 0; i < dof; ++ i)
+        {
+          if (i == 0)
+            kij = ga[0]*DB[0][j] + ga[1]*DB[3][j] + ga[2]*DB[5][j];
+          else if (i == 1)
+            kij = ga[1]*DB[1][j] + ga[0]*DB[3][j] + ga[2]*DB[4][j];
+          else
+            kij = ga[2]*DB[2][j] + ga[1]*DB[4][j] + ga[0]*DB[5][j];
+          if (i == j)
+            kij += saa;
+          block[i*MAX_DOF + j] += kij*volume;
+        }
     }
   }
 }
 
-void solver_create_residual_forces(fea_solver_ptr self)
+/*
+ * Prepare the matrix-free operator: material tangents in gauss nodes
+ * and the preconditioner formed from diagonal blocks of the tangent
+ */
+static void solver_create_tangents(fea_solver_ptr self)
 {
-  int el = 0;
-  memset(self->global_forces_vct,0,sizeof(real)*self->global_mtx.rows_count);
+  int color,i,j,k;
+  int dof = self->task_p->dof;
+  real block[MAX_DOF][MAX_DOF];
+  real det;
 
-  for (; el < self->elements_p->elements_count; ++ el)
-    solver_local_residual_forces(self, el);
+  if (self->node_blocks)
+    memset(self->node_blocks,0,
+           sizeof(real)*MAX_DOF*MAX_DOF*self->nodes_p->nodes_count);
+  for (color = 0; color < self->colors_count; ++ color)
+  {
+#pragma omp parallel for schedule(static)
+    for (i = self->colors_offsets[color];
+         i < self->colors_offsets[color+1]; ++ i)
+      solver_local_tangents(self,self->colored_elements[i]);
+  }
+  if (!self->node_blocks)
+    return;
+  for (i = 0; i < self->nodes_p->nodes_count; ++ i)
+  {
+    for (j = 0; j < MAX_DOF; ++ j)
+      for (k = 0; k < MAX_DOF; ++ k)
+        block[j][k] = self->node_blocks[i][j*MAX_DOF + k];
+    /* eliminated d.o.f. are decoupled unit equations */
+    for (j = 0; j < dof; ++ j)
+      if (self->equations[i*dof + j] < 0)
+      {
+        for (k = 0; k < MAX_DOF; ++ k)
+          block[j][k] = block[k][j] = 0;
+        block[j][j] = 1;
+      }
+    if (self->task_p->preconditioner == PRECONDITIONER_JACOBI)
+    {
+      for (j = 0; j < MAX_DOF; ++ j)
+        for (k = 0; k < MAX_DOF; ++ k)
+          block[j][k] = j == k ? 1/block[j][j] : 0;
+    }
+    else if (!inv3x3(block,&det))
+      error("solver_create_tangents: singular diagonal block");
+    for (j = 0; j < MAX_DOF; ++ j)
+      for (k = 0; k < MAX_DOF; ++ k)
+        self->node_blocks[i][j*MAX_DOF + k] = block[j][k];
+  }
 }
 
 /* Create global stiffness matrix */
 void solver_create_stiffness(fea_solver_ptr self)
 {
-  int el;
+  int color,i;
+  int size = self->nodes_p->nodes_count*self->task_p->dof;
+  /* the matrix-free operator needs tangents in gauss nodes only */
+  if (self->task_p->matrix_free)
+  {
+    solver_create_tangents(self);
+    return;
+  }
+  /* the sparsity pattern is created only once */
+  if (!self->stiffness_map)
+    solver_create_stiffness_pattern(self);
   /* clear global stiffness matrix before constructing a new one */
-  sp_matrix_clear(&self->global_mtx);
-  for (el = 0; el < self->elements_p->elements_count; ++ el)
+  solver_clear_stiffness(self);
+  /* factorization of the previous matrix is not valid anymore */
+  solver_chol_factor_free(self);
+  self->amg = amg_free(self->amg);
+  /*
+   * elements of the same color do not share nodes, therefore
+   * they never update the same components of the global matrix
+   */
+  for (color = 0; color < self->colors_count; ++ color)
+  {
+#pragma omp parallel for schedule(static)
+    for (i = self->colors_offsets[color];
+         i < self->colors_offsets[color+1]; ++ i)
+      solver_local_stiffness(self,self->colored_elements[i]);
+  }
+  /* eliminated d.o.f. in the block storage become decoupled equations */
+  if (self->block_storage && self->equations_count != size)
   {
-    solver_local_constitutive_part(self,el);
-    solver_local_initial_stess_part(self,el);
+    for (i = 0; i < size; ++ i)
+      if (self->equations[i] < 0)
+        *bsr_matrix_element(&self->global_bsr,i,i) = 1;
   }
 }
 
 
 
-void solver_local_constitutive_part(fea_solver_ptr self,int element)
+void solver_local_stiffness(fea_solver_ptr self,int element)
 {
   /* matrix of gradients of shape functions */
   shape_gradients_ptr grads = (shape_gradients_ptr)0;
-  int gauss,a,b,i,j,k,l,I,J,globalI,globalJ;
+  int gauss,a,b,i,j,k,l,r,I,J,globalI,globalJ;
   real sum;
+  /* initial stress component for the pair of nodes a,b */
+  real sab;
+  /* volume of the gauss node: det(J) multiplied by weight */
+  real volume;
   /* size of a local stiffness matrix */
   int size;
   /* number of nodes per element */
   int nelem;
   /* current number of d.o.f */
   int dof;
-  /* local stiffness matrix */
-  real **stiff = (real**)0;
-  /* C tensor depending on material model */
-  real ctens[MAX_DOF][MAX_DOF][MAX_DOF][MAX_DOF];
-  
-  real cikjl = 0;
-  /* allocate memory for a local stiffness matrix */
-  size = self->fea_params_p->nodes_per_element*self->task_p->dof;
-  stiff = (real**)malloc(sizeof(real*)*size);
-  for (i = 0; i < size; ++ i)
-  {
-    stiff[i] = (real*)malloc(sizeof(real)*size);
-    memset(stiff[i],0,sizeof(real)*size);
-  }
-    
+  /* local stiffness matrix, [size x size] stored by rows */
+  real stiff[MAX_ELEMENT_DOF*MAX_ELEMENT_DOF];
+  /* C tensor depending on material model in Voigt notation */
+  real D[VOIGT_SIZE][VOIGT_SIZE];
+  /* products D*B_b for all nodes b of the element */
+  real DB[MAX_NODES_PER_ELEMENT][VOIGT_SIZE][MAX_DOF];
+  /* block [K_{ab}]ij, 3x3 */
+  real Kab[MAX_DOF][MAX_DOF];
+  /* gradients of shape functions for nodes a and b */
+  real ga[MAX_DOF],gb[MAX_DOF];
+  /* Cauchy stress tensor in gauss node */
+  real (*stress)[MAX_DOF];
+  /* offsets of the local stiffness components in the global matrix */
+  int* map;
+  int index;
+  /* gauss nodes of the element in arrays of graddefs and stresses */
+  int gauss_count = self->fea_params_p->gauss_nodes_count;
+  tensor_ptr graddefs = self->graddefs + element*gauss_count;
+  tensor_ptr stresses = self->stresses + element*gauss_count;
+
   dof = self->task_p->dof;
   nelem = self->fea_params_p->nodes_per_element;
+  size = nelem*dof;
+  assert(size <= MAX_ELEMENT_DOF);
+  assert(dof == MAX_DOF);
+  memset(stiff,0,sizeof(real)*size*size);
   
   /* loop by gauss nodes - numerical integration */
-  for (gauss = 0; gauss < self->fea_params_p->gauss_nodes_count ; ++ gauss)
+  for (gauss = 0; gauss < gauss_count; ++ gauss)
   {
-    /* obtain a C tensor */
-    self->task_p->model.ctensor(&self->task_p->model,
-                                self->graddefs[element][gauss].components,
-                                ctens);
-
-    grads = self->shape_gradients[element][gauss];
-    if (grads)
+    grads = solver_shape_gradients(self,TRUE,element,gauss);
+    /* obtain a C tensor in Voigt notation */
+    self->task_p->model.ctensor_voigt(&self->task_p->model,
+                                      graddefs[gauss].components,
+                                      D);
+    stress = stresses[gauss].components;
+    /*
+     * volume of an element = det(J) multiplied by the weight of the
+     * gauss node, where divider 6 or 2 or others already accounted in
+     * weights of gauss nodes
+     */
+    volume = fabs(grads->detJ)*self->elements_db.gauss_nodes[gauss]->weight;
+
+    /*
+     * Constitutive component of the stiffness matrix is
+     * [K_{ab}] = B_a^T D B_b, where B_b is the [6 x 3] matrix
+     * of gradients of shape function of the node b:
+     * | dN/dx   0     0   |
+     * |   0   dN/dy   0   |
+     * |   0     0   dN/dz |
+     * | dN/dy dN/dx   0   |
+     * |   0   dN/dz dN/dy |
+     * | dN/dz   0   dN/dx |
+     * First calculate products D*B_b for all nodes
+     */
+    for (b = 0; b < nelem; ++ b)
     {
-      /* Construct components of stiffness matrix in
-       * indical form using Bonet & Wood 7.35 p.207, 1st edition */
+      gb[0] = grads->grads[0][b];
+      gb[1] = grads->grads[1][b];
+      gb[2] = grads->grads[2][b];
+      for (r = 0; r < VOIGT_SIZE; ++ r)
+      {
+        DB[b][r][0] = D[r][0]*gb[0] + D[r][3]*gb[1] + D[r][5]*gb[2];
+        DB[b][r][1] = D[r][1]*gb[1] + D[r][3]*gb[0] + D[r][4]*gb[2];
+        DB[b][r][2] = D[r][2]*gb[2] + D[r][4]*gb[1] + D[r][5]*gb[0];
+      }
+    }
+    
+    /* Construct components of stiffness matrix in
+     * indical form using Bonet & Wood 7.35 p.207, 1st edition */
       
-      /* loop by nodes */
-      for ( a = 0; a < nelem; ++ a)
-        for (b = 0; b < nelem; ++ b)
+    /* loop by nodes, the local stiffness matrix is symmetric */
+    for ( a = 0; a < nelem; ++ a)
+    {
+      ga[0] = grads->grads[0][a];
+      ga[1] = grads->grads[1][a];
+      ga[2] = grads->grads[2][a];
+      for (b = a; b < nelem; ++ b)
+      {
+        /*
+         * initial stress component is the same for all diagonal
+         * components of the block [K_{ab}]ij
+         */
+        sab = 0.0;
+        for (k = 0; k < dof; ++ k)
+          for (l = 0; l < dof; ++ l)
+            sab += ga[k]*stress[k][l]*grads->grads[l][b];
+        /* constitutive component B_a^T (D B_b) */
+        for (j = 0; j < dof; ++ j)
         {
-          /* loop by d.o.f in a stiffness matrix block [K_{ab}]ij, 3x3 */
-          for (i = 0; i < dof; ++ i)
-            for (j = 0; j < dof; ++ j)
-            {
-              /* indicies in a local stiffness matrix */
-              I = a*dof + i;
-              J = b*dof + j;
-              sum = 0.0;
-              /* sum of particular derivatives and components of C tensor */
-              for (k = 0; k < dof; ++ k)
-                for (l = 0; l < dof; ++ l)
-                {
-                  /* cikjl = ctens[i][k][j][l]; */
-                  cikjl = (ctens[i][k][j][l]+ctens[i][k][l][j]+
-                           ctens[k][i][j][l]+ctens[k][i][l][j])/4.;
-                  sum += 
-                    grads->grads[k][a]*cikjl*grads->grads[l][b];
-                }
-              /*
-               * multiply by volume of an element = det(J)
-               * where divider 6 or 2 or others already accounted in
-               * weights of gauss nodes
-               */
-              sum *= fabs(grads->detJ);
-              /* ... and weight of the gauss nodes for  */
-              sum *= self->elements_db.gauss_nodes[gauss]->weight;
-              /* append to the local stiffness */
-              stiff[I][J] += sum;
-              /* finally distribute to the global matrix */
-              globalI = self->elements_p->elements[element][a]*dof + i;
-              globalJ = self->elements_p->elements[element][b]*dof + j;
-              sp_matrix_element_add(&self->global_mtx,
-                                    globalI,
-                                    globalJ,
-                                    sum);
-            }
+          Kab[0][j] = ga[0]*DB[b][0][j] + ga[1]*DB[b][3][j] +
+            ga[2]*DB[b][5][j];
+          Kab[1][j] = ga[1]*DB[b][1][j] + ga[0]*DB[b][3][j] +
+            ga[2]*DB[b][4][j];
+          Kab[2][j] = ga[2]*DB[b][2][j] + ga[1]*DB[b][4][j] +
+            ga[0]*DB[b][5][j];
         }
+        /* loop by d.o.f in a stiffness matrix block [K_{ab}]ij, 3x3 */
+        for (i = 0; i < dof; ++ i)
+          for (j = 0; j < dof; ++ j)
+          {
+            /* indicies in a local stiffness matrix */
+            I = a*dof + i;
+            J = b*dof + j;
+            sum = Kab[i][j];
+            if (i == j)
+              sum += sab;
+            sum *= volume;
+            /* append to the local stiffness */
+            stiff[I*size + J] += sum;
+            /* and to the symmetric block [K_{ba}] */
+            if (a != b)
+              stiff[J*size + I] += sum;
+          }
+      }
     }
   }
   
 #ifdef DUMP_DATA
   solver_dump_local_stiffness(self,stiff,element);
 #endif
-  
-  /* clear local stiffness */
-  for ( i = 0; i < size; ++ i )
-    free(stiff[i]);
-  free(stiff);
-}
 
-/* Create initial stress component of the stiffness matrix */
-void solver_local_initial_stess_part(fea_solver_ptr self,int element)
-{
-  /* matrix of gradients of shape functions */
-  shape_gradients_ptr grads = (shape_gradients_ptr)0;
-  int gauss,a,b,i,j,k,l,I,J,globalI,globalJ;
-  real sum;
-  /* size of a local stiffness matrix */
-  int size;
-  /* number of nodes per element */
-  int nelem;
-  /* current number of d.o.f */
-  int dof;
-  /* local stiffness matrix */
-  real **stiff = (real**)0;
-  
-  /* allocate memory for a local stiffness matrix */
-  size = self->fea_params_p->nodes_per_element*self->task_p->dof;
-  stiff = (real**)malloc(sizeof(real*)*size);
-  for (i = 0; i < size; ++ i)
-  {
-    stiff[i] = (real*)malloc(sizeof(real)*size);
-    memset(stiff[i],0,sizeof(real)*size);
-  }
-  
-  dof = self->task_p->dof;
-  nelem = self->fea_params_p->nodes_per_element;
-  
-  /* loop by gauss nodes - numerical integration */
-  for (gauss = 0; gauss < self->fea_params_p->gauss_nodes_count ; ++ gauss)
+  /* finally distribute to the global matrix using precomputed offsets */
+  map = self->stiffness_map + element*size*size;
+  for (I = 0; I < size; ++ I)
   {
-    grads = self->shape_gradients[element][gauss];
-    if (grads)
+    globalI = self->equations[self->elements_p->elements[element][I/dof]*dof +
+                              I%dof];
+    for (J = 0; J < size; ++ J)
     {
-      /* Construct components of stiffness matrix in
-       * indical form using Bonet & Wood 7.35 p.207, 1st edition */
-      
-      /* loop by nodes */
-      for ( a = 0; a < nelem; ++ a)
-        for (b = 0; b < nelem; ++ b)
-        {
-          /* loop by d.o.f in a stiffness matrix block [K_{ab}]ij, 3x3 */
-          for (i = 0; i < dof; ++ i)
-            for (j = 0; j < dof; ++ j)
-            {
-              /* indicies in a local stiffness matrix */
-              I = a*dof + i;
-              J = b*dof + j;
-              sum = 0.0;
-              /* sum of particular derivatives and components of C tensor */
-              for (k = 0; k < dof; ++ k)
-                for (l = 0; l < dof; ++ l)
-                  sum += 
-                    grads->grads[k][a] *
-                    self->stresses[element][gauss].components[k][l] *
-                    grads->grads[l][b] *
-                    DELTA(i,j);
-              /*
-               * multiply by volume of an element = det(J)
-               * where divider 6 or 2 or others already accounted in
-               * weights of gauss nodes
-               */
-              sum *= fabs(grads->detJ);
-              /* ... and weight of the gauss nodes for  */
-              sum *= self->elements_db.gauss_nodes[gauss]->weight;
-              /* append to the local stiffness */
-              stiff[I][J] += sum;
-              /* finally distribute to the global matrix */
-              globalI = self->elements_p->elements[element][a]*dof + i;
-              globalJ = self->elements_p->elements[element][b]*dof + j;
-              sp_matrix_element_add(&self->global_mtx,
-                                    globalI,
-                                    globalJ,
-                                    sum);
-            }
-        }
+      if (map[I*size + J] < 0)
+        continue;
+      globalJ =
+        self->equations[self->elements_p->elements[element][J/dof]*dof +
+                        J%dof];
+      if (self->block_storage)
+      {
+        ((real*)self->global_bsr.values)[map[I*size + J]] +=
+          stiff[I*size + J];
+        continue;
+      }
+      index = self->global_mtx.storage_type == CCS ? globalJ : globalI;
+      self->global_mtx.storage[index].values[map[I*size + J]] +=
+        stiff[I*size + J];
     }
   }
-    
-  /* clear local stiffness */
-  for ( i = 0; i < size; ++ i )
-    free(stiff[i]);
-  free(stiff);
 }
 
 
@@ -1080,35 +2568,34 @@ void solver_local_residual_forces(fea_solver_ptr self,int element)
   shape_gradients_ptr grads = (shape_gradients_ptr)0;
   int nelem = self->fea_params_p->nodes_per_element;
   int dof = self->task_p->dof;
+  int gauss_count = self->fea_params_p->gauss_nodes_count;
+  tensor_ptr stresses = self->stresses + element*gauss_count;
 
-  for (gauss = 0; gauss < self->fea_params_p->gauss_nodes_count ; ++ gauss)
+  for (gauss = 0; gauss < gauss_count; ++ gauss)
   {
-    grads = self->shape_gradients[element][gauss];
-    if (grads)
-    {
-      /* loop by nodes */
-      for ( a = 0; a < nelem; ++ a)
-        /* loop by d.o.f in a residual vector matrix block T_{ai}, 3x1 */
-        for (i = 0; i < dof; ++ i)
-        {
-          sum = 0.0;
-          /* sum of particular derivatives and components of C tensor */
-          for (j = 0; j < dof; ++ j)
-            sum += self->stresses[element][gauss].components[i][j] *
-              grads->grads[j][a];
-          /*
-           * multiply by volume of an element = det(J)
-           * where divider 6 or 2 or others already accounted in
-           * weights of gauss nodes
-           */
-          sum *= fabs(grads->detJ);
-          /* ... and weight of the gauss node */
-          sum *= self->elements_db.gauss_nodes[gauss]->weight;
-          /* finally distribute to the global residual forces vector */
-          I = self->elements_p->elements[element][a]*dof + i;
-          self->global_forces_vct[I] += -sum;
-        }
-    }
+    grads = solver_shape_gradients(self,TRUE,element,gauss);
+    /* loop by nodes */
+    for ( a = 0; a < nelem; ++ a)
+      /* loop by d.o.f in a residual vector matrix block T_{ai}, 3x1 */
+      for (i = 0; i < dof; ++ i)
+      {
+        sum = 0.0;
+        /* sum of particular derivatives and components of C tensor */
+        for (j = 0; j < dof; ++ j)
+          sum += stresses[gauss].components[i][j] *
+            grads->grads[j][a];
+        /*
+         * multiply by volume of an element = det(J)
+         * where divider 6 or 2 or others already accounted in
+         * weights of gauss nodes
+         */
+        sum *= fabs(grads->detJ);
+        /* ... and weight of the gauss node */
+        sum *= self->elements_db.gauss_nodes[gauss]->weight;
+        /* finally distribute to the global residual forces vector */
+        I = self->elements_p->elements[element][a]*dof + i;
+        self->global_forces_vct[I] += -sum;
+      }
   }
 
 }
@@ -1137,7 +2624,7 @@ void solver_element_gauss_graddef(fea_solver_ptr self,
    * See Bonet & Wood 7.6(a,b), 7.7 p.198, 1st edition
    */
   real detF = 0;
-  shape_gradients_ptr grads = self->shape_gradients[element][gauss];
+  shape_gradients_ptr grads = solver_shape_gradients(self,TRUE,element,gauss);
   for (i = 0; i < MAX_DOF; ++ i)
   {
     for (j = 0; j < MAX_DOF; ++ j)
@@ -1167,7 +2654,7 @@ void solver_element_gauss_graddef(fea_solver_ptr self,
       graddef[i][j] = 0;
       for (k = 0; k < self->fea_params_p->nodes_per_element; ++ k)
         graddef[i][j] +=
-          self->shape_gradients0[element][gauss]->grads[j][k] *
+          solver_shape_gradients(self,FALSE,element,gauss)->grads[j][k] *
           self->nodes_p->nodes[self->elements_p->elements[element][k]][i];
     }
   }
@@ -1199,9 +2686,56 @@ void solver_create_forces_bc(fea_solver_ptr self)
 
 void solver_apply_prescribed_bc(fea_solver_ptr self, real lambda)
 {
+  /*
+   * eliminated prescribed d.o.f. are not in the global system.
+   * Prescribed displacements are applied to nodes before Newton
+   * iterations, so only homogeneous conditions are expected here
+   */
+  if (self->task_p->eliminate_prescribed || self->task_p->matrix_free)
+  {
+    assert(lambda == 0);
+    return;
+  }
   solver_apply_bc_general(self,solver_apply_single_bc,lambda);
 }
 
+void solver_apply_prescribed_bc_forces(fea_solver_ptr self, real lambda)
+{
+  if (self->task_p->eliminate_prescribed || self->task_p->matrix_free)
+  {
+    assert(lambda == 0);
+    return;
+  }
+  solver_apply_bc_general(self,solver_apply_single_bc_forces,lambda);
+}
+
+/* Marks prescribed d.o.f. in the equations array with -1 */
+static void solver_exclude_equation(fea_solver_ptr self,
+                                    int index, real presc UNUSED)
+{
+  self->equations[index] = -1;
+}
+
+void solver_create_equations(fea_solver_ptr self)
+{
+  int i;
+  int size = self->nodes0_p->nodes_count*self->task_p->dof;
+  self->equations = (int*)malloc(sizeof(int)*size);
+  for (i = 0; i < size; ++ i)
+    self->equations[i] = 0;
+  /* there is no matrix to cancel rows and columns in matrix-free mode */
+  if (self->task_p->eliminate_prescribed || self->task_p->matrix_free)
+    solver_apply_bc_general(self,solver_exclude_equation,0);
+  /* number the rest of d.o.f. sequentially */
+  self->equations_count = 0;
+  for (i = 0; i < size; ++ i)
+    if (self->equations[i] >= 0)
+      self->equations[i] = self->equations_count ++;
+  if (self->equations_count != size)
+    LOG("Prescribed d.o.f. eliminated, %d equations of %d",
+        self->equations_count, size);
+}
+
 void solver_apply_bc_general(fea_solver_ptr self,apply_bc_t apply,real lambda)
 {
   int i,j;
@@ -1244,7 +2778,21 @@ void solver_apply_bc_general(fea_solver_ptr self,apply_bc_t apply,real lambda)
 void solver_apply_single_bc(fea_solver_ptr self, int index, real presc)
 {
   real value;
-  int j;
+  int j,k;
+  int row = index/BSR_BLOCK_SIZE;
+  int r = index%BSR_BLOCK_SIZE;
+  if (self->block_storage)
+  {
+    /* the 'index' row of the block storage, j is the column */
+    for (k = self->global_bsr.offsets[row];
+         k < self->global_bsr.offsets[row+1]; ++ k)
+      for (j = 0; j < BSR_BLOCK_SIZE; ++ j)
+        self->global_forces_vct[self->global_bsr.indexes[k]*BSR_BLOCK_SIZE+j]
+          -= self->global_bsr.values[k][r*BSR_BLOCK_SIZE + j]*presc;
+    value = solver_matrix_cross_cancellation(self,index);
+    self->global_forces_vct[index] = value*presc;
+    return;
+  }
   /* update global forces vector */
   /* since matrix is symmetric ith row = ith column */
   for (j = 0; j <= self->global_mtx.storage[index].last_index; ++ j)
@@ -1252,10 +2800,75 @@ void solver_apply_single_bc(fea_solver_ptr self, int index, real presc)
       -= self->global_mtx.storage[index].values[j]*presc;
 
   /* cancellation of the 'index' row and column */
-  value = sp_matrix_cross_cancellation(&self->global_mtx,index);
+  value = solver_matrix_cross_cancellation(self,index);
   self->global_forces_vct[index] = value*presc;
 }
 
+void solver_apply_single_bc_forces(fea_solver_ptr self, int index, real presc)
+{
+  /*
+   * the 'index' row and column are already cancelled, so contributions
+   * of the column to other components of the forces vector are lost.
+   * Therefore only homogeneous conditions are supported, i.e. Newton
+   * corrections of the displacements
+   */
+  assert(presc == 0);
+  self->global_forces_vct[index] = presc;
+}
+
+/* Cross cancellation of the 'index' row and column of the block storage */
+static real solver_bsr_cross_cancellation(fea_solver_ptr self, int index)
+{
+  int j,k,col;
+  int row = index/BSR_BLOCK_SIZE;
+  int r = index%BSR_BLOCK_SIZE;
+  real value = 0;
+  for (k = self->global_bsr.offsets[row];
+       k < self->global_bsr.offsets[row+1]; ++ k)
+    for (j = 0; j < BSR_BLOCK_SIZE; ++ j)
+    {
+      col = self->global_bsr.indexes[k]*BSR_BLOCK_SIZE + j;
+      if (col == index)
+      {
+        value = self->global_bsr.values[k][r*BSR_BLOCK_SIZE + j];
+        continue;
+      }
+      self->global_bsr.values[k][r*BSR_BLOCK_SIZE + j] = 0;
+      /* the pattern of blocks is symmetric */
+      *bsr_matrix_element(&self->global_bsr,col,index) = 0;
+    }
+  return value;
+}
+
+real solver_matrix_cross_cancellation(fea_solver_ptr self, int index)
+{
+  int j,offset;
+  real value = 0;
+  indexed_array* array;
+  if (self->block_storage)
+    return solver_bsr_cross_cancellation(self,index);
+  array = &self->global_mtx.storage[index];
+  /*
+   * set to zero all elements of the 'index' row and column except
+   * diagonal one, keeping the sparsity pattern. Since the pattern
+   * is symmetric the 'index' row is found through the 'index' column
+   */
+  for (j = 0; j <= array->last_index; ++ j)
+  {
+    if (array->indexes[j] == index)
+    {
+      value = array->values[j];
+      continue;
+    }
+    array->values[j] = 0;
+    offset = solver_matrix_offset(&self->global_mtx,
+                                  index,array->indexes[j]);
+    if (offset >= 0)
+      self->global_mtx.storage[array->indexes[j]].values[offset] = 0;
+  }
+  return value;
+}
+
 void solver_update_node_with_bc(fea_solver_ptr self,
                                 int index,
                                 real value)
@@ -1283,6 +2896,101 @@ void solver_update_nodes_with_bc(fea_solver_ptr self, real lambda)
   solver_apply_bc_general(self,solver_update_node_with_bc,lambda) ;
 }
 
+BOOL solver_predict_nodes(fea_solver_ptr self, real increment)
+{
+  int i,j,k,l;
+  int count = self->task_p->predictor == PREDICTOR_QUADRATIC ? 3 : 2;
+  int steps = self->current_load_step;
+  real load[3],weight;
+  real (*nodes[3])[MAX_DOF];
+  real (*current)[MAX_DOF] = self->nodes_p->nodes;
+
+  if (self->task_p->predictor == PREDICTOR_NONE || steps == 0)
+    return FALSE;
+  /* the initial state is the converged state at zero load */
+  if (count > steps + 1)
+    count = steps + 1;
+  for (k = 0; k < count; ++ k)
+  {
+    l = steps - 1 - k;
+    load[k] = l >= 0 ? solver_load_step(self,l)->load : 0;
+    nodes[k] = l >= 0 ? solver_load_step(self,l)->nodes_p->nodes :
+      self->nodes0_p->nodes;
+  }
+  /*
+   * nodes[0] is the current state, so with the Lagrange weights w_k
+   * at the new load u_new - u_0 = sum_k w_k (u_k - u_0), k > 0
+   */
+  for (k = 1; k < count; ++ k)
+  {
+    weight = 1;
+    for (l = 0; l < count; ++ l)
+      if (l != k)
+        weight *= (load[0] + increment - load[l])/(load[k] - load[l]);
+    for (i = 0; i < self->nodes_p->nodes_count; ++ i)
+      for (j = 0; j < self->task_p->dof; ++ j)
+        current[i][j] += weight*(nodes[k][i][j] - nodes[0][i][j]);
+  }
+  return TRUE;
+}
+
+real solver_line_search(fea_solver_ptr self, real r0)
+{
+  int i,j,iter;
+  int dof = self->task_p->dof;
+  int size = self->nodes_p->nodes_count*dof;
+  real* x = self->global_solution_vct;
+  real eta = 1,eta_new,r,alpha;
+  real best_eta = 1,best_r = 0;
+
+  for (iter = 0; ; ++ iter)
+  {
+    /* residual at the trial configuration, the tangent is not rebuilt */
+    solver_create_residual_forces(self);
+    solver_apply_prescribed_bc_forces(self,0);
+    r = cdot(self->global_forces_vct,x,size);
+    /* the interpolation may make things worse: keep the best step */
+    if (iter > 0 && fabs(r) >= best_r)
+      break;
+    best_eta = eta;
+    best_r = fabs(r);
+    /*
+     * the step is reduced only if it overshoots, i.e. the residual
+     * projection changes its sign and the root is bracketed
+     */
+    alpha = r0/r;
+    if (best_r <= LINESEARCH_TOLERANCE*fabs(r0) || alpha > 0 ||
+        iter == self->task_p->linesearch_max)
+      break;
+    /*
+     * root of the quadratic interpolation of the residual projection
+     * r(eta) with r(0) = r0, r'(0) = -r0 and r(eta) = r,
+     * Bonet & Wood 2nd ed. section 9.6.3
+     */
+    eta_new = eta*(alpha/2 + sqrt(alpha*alpha/4 - alpha));
+    LOG("Line search %d: <X,R> = %e, step %f",iter+1,r,eta_new);
+    /* move nodes to the new step */
+    for (i = 0; i < self->nodes_p->nodes_count; ++ i)
+      for (j = 0; j < dof; ++ j)
+        self->nodes_p->nodes[i][j] += (eta_new - eta)*x[i*dof + j];
+    eta = eta_new;
+    solver_create_current_shape_gradients(self);
+    solver_create_stresses(self);
+  }
+  if (eta != best_eta)
+  {
+    for (i = 0; i < self->nodes_p->nodes_count; ++ i)
+      for (j = 0; j < dof; ++ j)
+        self->nodes_p->nodes[i][j] += (best_eta - eta)*x[i*dof + j];
+    solver_create_current_shape_gradients(self);
+    solver_create_stresses(self);
+  }
+  if (best_eta != 1)
+    for (i = 0; i < size; ++ i)
+      x[i] *= best_eta;
+  return best_eta;
+}
+
 
 real tetrahedra10_isoform(int i,real r,real s,real t)
 {
@@ -1372,7 +3080,50 @@ real tetrahedra10_disoform(int shape,int dof,real r,real s,real t)
   return 0;
 }
 
-void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver, const char *filename)
+BOOL tetrahedra10_shape_gradients(fea_solver_ptr self,
+                                  nodes_array_ptr nodes,
+                                  int element,
+                                  int gauss,
+                                  real (*grads)[MAX_NODES_PER_ELEMENT],
+                                  real* detJ)
+{
+  int i,j,k;
+  /* derivatives of shape functions in this gauss node */
+  real (*dforms)[TETRAHEDRA10_NODES] =
+    self->elements_db.tetrahedra10_dforms[gauss];
+  /* nodal coordinates of the element */
+  real x[TETRAHEDRA10_NODES][MAX_DOF];
+  /* J is a Jacobi matrix of transformation btw local and global */
+  /* coordinate systems */
+  real J[MAX_DOF][MAX_DOF];
+  real sum;
+  
+  for (k = 0; k < TETRAHEDRA10_NODES; ++ k)
+    for (j = 0; j < MAX_DOF; ++ j)
+      x[k][j] = solver_node_dof(self,nodes,element,k,j);
+  
+  /* Jacobi matrix, see solver_shape_gradients_generic */
+  for (i = 0; i < MAX_DOF; ++ i)
+    for (j = 0; j < MAX_DOF; ++ j)
+    {
+      sum = 0;
+      for (k = 0; k < TETRAHEDRA10_NODES; ++ k)
+        sum += dforms[i][k]*x[k][j];
+      J[i][j] = sum;
+    }
+  if (!inv3x3(J,detJ))                /* inverse doesn't exist */
+    return FALSE;
+
+  /* gradients = J^-1 * dforms */
+  for ( i = 0; i < MAX_DOF; ++ i)
+    for ( j = 0; j < TETRAHEDRA10_NODES; ++ j)
+      grads[i][j] =
+        J[i][0]*dforms[0][j] + J[i][1]*dforms[1][j] + J[i][2]*dforms[2][j];
+  return TRUE;
+}
+
+FILE* solver_export_tetrahedra10_gmsh_open(fea_solver_ptr solver,
+                                           const char *filename)
 {
   /* Our(left) and Gmsh(Right) nodal ordering.
    * 
@@ -1402,8 +3153,7 @@ void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver, const char *filename
    *                    Difference in nodes 8 <=> 9
    */
   FILE* f;
-  int i,j,k;
-  int load;
+  int i,j;
  
   f = fopen(filename,"w+");
   if ( f )
@@ -1435,63 +3185,211 @@ void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver, const char *filename
       fprintf(f,"\n");
     }
     fprintf(f,"$EndElements\n");
+    /* initial state */
+    solver_export_tetrahedra10_gmsh_step(solver,f,(load_step_ptr)0);
+  }
+  return f;
+}
+
+void solver_export_tetrahedra10_gmsh_step(fea_solver_ptr solver, FILE* f,
+                                          load_step_ptr step)
+{
+  int i,j,k;
+  /* step index (starting at 0), 0 - the initial state */
+  int load = step ? step->step_number + 1 : 0;
+  int gauss_count = solver->fea_params_p->gauss_nodes_count;
+
+  /* Export displacements */
+  fprintf(f,"$NodeData\n");
+  fprintf(f,"1\n");
+  fprintf(f,"\"Displacements\"\n");
+  fprintf(f,"1\n");           /* number-of-real-tags */
+  fprintf(f,"%f\n", (step ? step->load : 0)*0.83333333); /* timestamp */
+  fprintf(f,"3\n");           /* number-of-integer-tags */
+  fprintf(f,"%d\n", load);    /* step index (starting at 0) */
+  fprintf(f,"3\n");           /* number of field components (1, 3 or 9)*/
+  /* number of entities */
+  fprintf(f,"%d\n",solver->nodes_p->nodes_count);
+  for (i = 0; i < solver->nodes_p->nodes_count; ++ i)
+    fprintf(f,"%d %f %f %f\n",i+1,
+            step ? step->nodes_p->nodes[i][0] -
+            solver->nodes0_p->nodes[i][0] : 0.0,
+            step ? step->nodes_p->nodes[i][1] -
+            solver->nodes0_p->nodes[i][1] : 0.0,
+            step ? step->nodes_p->nodes[i][2] -
+            solver->nodes0_p->nodes[i][2] : 0.0);
+  fprintf(f,"$EndNodeData\n");
     
-    /* loop by load increments */
-    for ( load = 0; load <= solver->current_load_step; ++ load)
-    {
-      /* Export displacements */
-      fprintf(f,"$NodeData\n");
-      fprintf(f,"1\n");
-      fprintf(f,"\"Displacements\"\n");
-      fprintf(f,"1\n");           /* number-of-real-tags */
-      fprintf(f,"%f\n", load*0.83333333);    /* timestamp */
-      fprintf(f,"3\n");           /* number-of-integer-tags */
-      fprintf(f,"%d\n", load);           /* step index (starting at 0) */
-      fprintf(f,"3\n");           /* number of field components (1, 3 or 9)*/
-      /* number of entities */
-      fprintf(f,"%d\n",solver->nodes_p->nodes_count);
-      for (i = 0; i < solver->nodes_p->nodes_count; ++ i)
-        fprintf(f,"%d %f %f %f\n",i+1,
-                load ? solver->load_steps_p[load-1].nodes_p->nodes[i][0] -
-                solver->nodes0_p->nodes[i][0] : 0.0,
-                load ? solver->load_steps_p[load-1].nodes_p->nodes[i][1] -
-                solver->nodes0_p->nodes[i][1] : 0.0,
-                load ? solver->load_steps_p[load-1].nodes_p->nodes[i][2] -
-                solver->nodes0_p->nodes[i][2] : 0.0);
-      fprintf(f,"$EndNodeData\n");
-    
-      /* Export stresses */
-      fprintf(f,"$ElementData\n");
-      fprintf(f,"1\n");           /* number-of-string-tags */
-      fprintf(f,"\"Stress tensor\"\n"); /* string tag */
-      fprintf(f,"1\n");           /* number-of-real-tags */
-      fprintf(f,"%f\n",load*0.83333333);         /* timestamp */
-      fprintf(f,"3\n");           /* number-of-integer-tags */
-      fprintf(f,"%d\n",load);           /* step index (starting at 0) */
-      fprintf(f,"9\n");           /* number of field components (1, 3 or 9) */
-      /* number of entities */
-      fprintf(f,"%d\n",solver->elements_p->elements_count);
-      for (i = 0; i < solver->elements_p->elements_count; ++ i)
-      {
-        fprintf(f,"%d ",i+1);     /* element index */
-        for ( j = 0; j < MAX_DOF; ++ j)
-          for ( k = 0; k < MAX_DOF; ++ k)
-            fprintf(f,"%f ", load ?
-                    solver->load_steps_p[load-1].stresses[i][0].components[j][k]
-                    : 0.0); 
-        fprintf(f,"\n");
-      }
-      fprintf(f,"$EndElementData\n");
-    }
-    fclose(f);
+  /* Export stresses */
+  fprintf(f,"$ElementData\n");
+  fprintf(f,"1\n");           /* number-of-string-tags */
+  fprintf(f,"\"Stress tensor\"\n"); /* string tag */
+  fprintf(f,"1\n");           /* number-of-real-tags */
+  fprintf(f,"%f\n",(step ? step->load : 0)*0.83333333); /* timestamp */
+  fprintf(f,"3\n");           /* number-of-integer-tags */
+  fprintf(f,"%d\n",load);     /* step index (starting at 0) */
+  fprintf(f,"9\n");           /* number of field components (1, 3 or 9) */
+  /* number of entities */
+  fprintf(f,"%d\n",solver->elements_p->elements_count);
+  for (i = 0; i < solver->elements_p->elements_count; ++ i)
+  {
+    fprintf(f,"%d ",i+1);     /* element index */
+    for ( j = 0; j < MAX_DOF; ++ j)
+      for ( k = 0; k < MAX_DOF; ++ k)
+        fprintf(f,"%f ", step ?
+                step->stresses[i*gauss_count].components[j][k]
+                : 0.0); 
+    fprintf(f,"\n");
   }
+  fprintf(f,"$EndElementData\n");
+  /* results written so far survive an aborted run */
+  fflush(f);
 }
                 
 
+/*
+ * Write count records of the binary Gmsh data: an integer index
+ * (starting at 1) followed by size doubles taken from values, which
+ * are stored with the stride. Records are packed to one buffer and
+ * written at once
+ */
+static void gmsh_write_binary_records(FILE* f, int count, int size,
+                                      real* values, int stride)
+{
+  int i,j;
+  int record = sizeof(int) + sizeof(double)*size;
+  char* buffer = (char*)malloc(record*(count > 0 ? count : 1));
+  char* ptr = buffer;
+  double value;
+  for (i = 0; i < count; ++ i)
+  {
+    j = i + 1;
+    memcpy(ptr,&j,sizeof(int));
+    ptr += sizeof(int);
+    for (j = 0; j < size; ++ j)
+    {
+      value = values ? values[i*stride + j] : 0.0;
+      memcpy(ptr,&value,sizeof(double));
+      ptr += sizeof(double);
+    }
+  }
+  fwrite(buffer,record,count,f);
+  free(buffer);
+}
+
+FILE* solver_export_tetrahedra10_gmsh_binary_open(fea_solver_ptr solver,
+                                                  const char *filename)
+{
+  FILE* f;
+  int i,j;
+  int one = 1;
+  int count = solver->elements_p->elements_count;
+  /* element-type, number-of-elements-following, number-of-tags */
+  int header[3] = {11, 0, 3};
+  /* number, 3 tags and 10 nodes per element */
+  int* elements;
+  int* ptr;
+
+  f = fopen(filename,"wb");
+  if ( f )
+  {
+    /* Header with the integer 1 to detect the endianness */
+    fprintf(f,"$MeshFormat\n");
+    fprintf(f,"2.0 1 %d\n",(int)sizeof(double));
+    fwrite(&one,sizeof(int),1,f);
+    fprintf(f,"\n$EndMeshFormat\n");
+    /* Nodes section */
+    fprintf(f,"$Nodes\n");
+    fprintf(f,"%d\n",solver->nodes0_p->nodes_count);
+    gmsh_write_binary_records(f,solver->nodes0_p->nodes_count,3,
+                              &solver->nodes0_p->nodes[0][0],MAX_DOF);
+    fprintf(f,"\n$EndNodes\n");
+    /* Elements section, all elements are of one type */
+    fprintf(f,"$Elements\n");
+    fprintf(f,"%d\n",count);
+    header[1] = count;
+    fwrite(header,sizeof(int),3,f);
+    elements = (int*)malloc(sizeof(int)*14*(count > 0 ? count : 1));
+    ptr = elements;
+    for (i = 0; i < count; ++ i)
+    {
+      *ptr++ = i+1;
+      *ptr++ = 1;
+      *ptr++ = 1;
+      *ptr++ = 1;
+      /* the same nodal ordering as the text export: 8 <=> 9 */
+      for (j = 0; j < 8; ++ j)
+        *ptr++ = solver->elements_p->elements[i][j]+1;
+      *ptr++ = solver->elements_p->elements[i][9]+1;
+      *ptr++ = solver->elements_p->elements[i][8]+1;
+    }
+    fwrite(elements,sizeof(int)*14,count,f);
+    free(elements);
+    fprintf(f,"\n$EndElements\n");
+    /* initial state */
+    solver_export_tetrahedra10_gmsh_binary_step(solver,f,(load_step_ptr)0);
+  }
+  return f;
+}
+
+void solver_export_tetrahedra10_gmsh_binary_step(fea_solver_ptr solver,
+                                                 FILE* f,
+                                                 load_step_ptr step)
+{
+  int i,j;
+  int load = step ? step->step_number + 1 : 0;
+  int nodes_count = solver->nodes_p->nodes_count;
+  int gauss_count = solver->fea_params_p->gauss_nodes_count;
+  real* values = (real*)0;
+
+  /* Export displacements */
+  fprintf(f,"$NodeData\n");
+  fprintf(f,"1\n");
+  fprintf(f,"\"Displacements\"\n");
+  fprintf(f,"1\n");             /* number-of-real-tags */
+  fprintf(f,"%.16g\n",(step ? step->load : 0)*0.83333333); /* timestamp */
+  fprintf(f,"3\n");             /* number-of-integer-tags */
+  fprintf(f,"%d\n",load);       /* step index (starting at 0) */
+  fprintf(f,"3\n");             /* number of field components */
+  fprintf(f,"%d\n",nodes_count);
+  if (step)
+  {
+    values = (real*)malloc(sizeof(real)*MAX_DOF*nodes_count);
+    for (i = 0; i < nodes_count; ++ i)
+      for (j = 0; j < MAX_DOF; ++ j)
+        values[i*MAX_DOF + j] = step->nodes_p->nodes[i][j] -
+          solver->nodes0_p->nodes[i][j];
+  }
+  gmsh_write_binary_records(f,nodes_count,3,values,MAX_DOF);
+  free(values);
+  fprintf(f,"\n$EndNodeData\n");
+
+  /* Export stresses in the first gauss node of elements */
+  fprintf(f,"$ElementData\n");
+  fprintf(f,"1\n");             /* number-of-string-tags */
+  fprintf(f,"\"Stress tensor\"\n"); /* string tag */
+  fprintf(f,"1\n");             /* number-of-real-tags */
+  fprintf(f,"%.16g\n",(step ? step->load : 0)*0.83333333); /* timestamp */
+  fprintf(f,"3\n");             /* number-of-integer-tags */
+  fprintf(f,"%d\n",load);       /* step index (starting at 0) */
+  fprintf(f,"9\n");             /* number of field components */
+  fprintf(f,"%d\n",solver->elements_p->elements_count);
+  gmsh_write_binary_records(f,solver->elements_p->elements_count,9,
+                            step ?
+                            &step->stresses[0].components[0][0] :
+                            (real*)0,
+                            gauss_count*MAX_DOF*MAX_DOF);
+  fprintf(f,"\n$EndElementData\n");
+  fflush(f);
+}
+
+
 void solver_create_element_params_tetrahedra10(fea_solver* solver)
 {
   solver->shape = tetrahedra10_isoform;
   solver->dshape = tetrahedra10_disoform;
+  if (solver->fea_params_p->nodes_per_element != 10)
+    error("solver_create_element_params_tetrahedra10: nodes count");
   switch (solver->fea_params_p->gauss_nodes_count)
   {
   case 4:
@@ -1502,7 +3400,18 @@ void solver_create_element_params_tetrahedra10(fea_solver* solver)
     break;
   default: error("solver_create_element_params_tetrahedra10: gauss nodes");
   }
-  solver->export_function = solver_export_tetrahedra10_gmsh;
+  /* all supported gauss nodes fit the specialized version */
+  solver->shape_gradients_func = tetrahedra10_shape_gradients;
+  if (solver->task_p->export_format == EXPORT_GMSH_BINARY)
+  {
+    solver->export_open = solver_export_tetrahedra10_gmsh_binary_open;
+    solver->export_step = solver_export_tetrahedra10_gmsh_binary_step;
+  }
+  else
+  {
+    solver->export_open = solver_export_tetrahedra10_gmsh_open;
+    solver->export_step = solver_export_tetrahedra10_gmsh_step;
+  }
 }
 
 
@@ -1516,15 +3425,41 @@ fea_task_ptr fea_task_alloc()
   task->ele_type = TETRAHEDRA10;
   task->linesearch_max = 0;
   task->arclength_max = 0;
+  task->bfgs_max = 0;
   task->load_increments_count = 0;
   task->max_newton_count = 0;
   task->type = CARTESIAN3D;
   task->modified_newton = TRUE;
+  task->adaptive_increments = FALSE;
+  task->min_increment = ADAPTIVE_MIN_INCREMENT;
+  task->max_increment = ADAPTIVE_MAX_INCREMENT;
+  task->target_newton_count = ADAPTIVE_TARGET_NEWTON_COUNT;
+  task->predictor = PREDICTOR_NONE;
+  task->eliminate_prescribed = FALSE;
+  task->threads_count = 1;
+  task->solver_type = CHOLESKY;
+  task->solver_tolerance = MAX_ITERATIVE_TOLERANCE;
+  task->inexact_newton = FALSE;
+  task->max_forcing_term = FORCING_TERM_MAX;
+  task->solver_max_iter = MAX_ITERATIVE_ITERATIONS;
+  task->ordering = ORDERING_NESTED_DISSECTION;
+  task->ilu_refresh_count = ILU_REFRESH_COUNT;
+  task->ilu_refresh_factor = ILU_REFRESH_FACTOR;
+  task->amg.strength = AMG_STRENGTH;
+  task->amg.coarse_size = AMG_COARSE_SIZE;
+  task->amg.max_levels = AMG_MAX_LEVELS;
+  task->amg.smooth_steps = AMG_SMOOTH_STEPS;
+  task->amg.prolongator_omega = AMG_PROLONGATOR_OMEGA;
+  task->matrix_free = FALSE;
+  task->preconditioner = PRECONDITIONER_BLOCK_JACOBI;
   task->model.model = MODEL_A5;
   task->model.parameters_count = 2;
   task->model.parameters[0] = 100;
   task->model.parameters[1] = 100;
   task->export_file = 0;
+  task->export_format = EXPORT_GMSH_ASCII;
+  task->mapped_data = (void*)0;
+  task->mapped_size = 0;
   return task;
 }
 
@@ -1532,6 +3467,7 @@ fea_task_ptr fea_task_free(fea_task_ptr task)
 {
   if (task->export_file)
     free((void*)task->export_file);
+  binary_data_unmap(task);
   free(task);
   return (fea_task_ptr)0;
 }
@@ -1561,28 +3497,26 @@ nodes_array_ptr nodes_array_alloc()
   /* allocate memory */
   nodes_array_ptr nodes = (nodes_array_ptr)malloc(sizeof(nodes_array));
   /* set zero values */
-  nodes->nodes = (real**)0;
+  nodes->nodes = (real(*)[MAX_DOF])0;
   nodes->nodes_count = 0;
+  nodes->mapped = FALSE;
   return nodes;
 }
 
 nodes_array_ptr nodes_array_copy_alloc(nodes_array_ptr nodes)
 {
-  int i;
   /* allocate memory */
   nodes_array_ptr copy = (nodes_array_ptr)malloc(sizeof(nodes_array));
   /* set zero values */
-  copy->nodes = (real**)0;
+  copy->nodes = (real(*)[MAX_DOF])0;
   copy->nodes_count = nodes->nodes_count;
-  /* copy nodes */
+  copy->mapped = FALSE;
+  /* copy nodes with one contiguous block */
   if ( nodes->nodes_count && nodes->nodes)
   {
-    copy->nodes = (real**)malloc(sizeof(real*)*copy->nodes_count);
-    for ( i = 0; i < copy->nodes_count; ++ i)
-    {
-      copy->nodes[i] = (real*)malloc(sizeof(real)*MAX_DOF);
-      memcpy(copy->nodes[i],nodes->nodes[i],sizeof(real)*MAX_DOF);
-    }
+    copy->nodes = (real(*)[MAX_DOF])
+      malloc(sizeof(real)*MAX_DOF*copy->nodes_count);
+    memcpy(copy->nodes,nodes->nodes,sizeof(real)*MAX_DOF*copy->nodes_count);
   }
   return copy;
 }
@@ -1590,15 +3524,10 @@ nodes_array_ptr nodes_array_copy_alloc(nodes_array_ptr nodes)
 /* carefully deallocate nodes array */
 nodes_array_ptr nodes_array_free(nodes_array_ptr nodes)
 {
-  int counter = 0;
   if (nodes)
   {
-    if (nodes->nodes_count && nodes->nodes)
-    {
-      for (; counter < nodes->nodes_count; ++ counter)
-        free(nodes->nodes[counter]);
+    if (!nodes->mapped)
       free(nodes->nodes);
-    }
     free(nodes);
   }
   return (nodes_array_ptr)0;
@@ -1612,8 +3541,9 @@ elements_array_ptr elements_array_alloc()
   elements_array_ptr elements = (elements_array_ptr)
     malloc(sizeof(elements_array));
   /* set zero values */
-  elements->elements = (int**)0;
+  elements->elements = (int(*)[MAX_NODES_PER_ELEMENT])0;
   elements->elements_count = 0;
+  elements->mapped = FALSE;
   return elements;
 }
 
@@ -1621,13 +3551,8 @@ elements_array_ptr elements_array_free(elements_array_ptr elements)
 {
   if(elements)
   {
-    int counter = 0;
-    if (elements->elements_count && elements->elements)
-    {
-      for (; counter < elements->elements_count; ++ counter)
-        free(elements->elements[counter]);
+    if (!elements->mapped)
       free(elements->elements);
-    }
     free(elements);
   }
   return (elements_array_ptr)0;
@@ -1642,6 +3567,7 @@ presc_bnd_array_ptr presc_bnd_array_alloc()
   /* set zero values */
   presc_boundary->prescribed_nodes = (prescribed_bnd_node*)0;
   presc_boundary->prescribed_nodes_count = 0;
+  presc_boundary->mapped = FALSE;
   return presc_boundary;
 }
 
@@ -1649,7 +3575,8 @@ presc_bnd_array_ptr presc_bnd_array_free(presc_bnd_array_ptr presc)
 {
   if (presc)
   {
-    if (presc->prescribed_nodes_count && presc->prescribed_nodes)
+    if (presc->prescribed_nodes_count && presc->prescribed_nodes &&
+        !presc->mapped)
     {
       free(presc->prescribed_nodes);
     }
@@ -1668,6 +3595,7 @@ BOOL initial_data_load(char *filename,
 {
   BOOL result = FALSE;
   static const char* sexp_ext = "sexp";
+  static const char* binary_ext = "ftask";
   /* guess by extension */
   char* ext_ptr = (char*)sp_parse_file_extension(filename);
 
@@ -1675,12 +3603,18 @@ BOOL initial_data_load(char *filename,
   {
     if (!sp_istrcmp(ext_ptr, sexp_ext))
     {
-      result = sexp_data_load(filename,task,fea_params,nodes,elements,
-                              presc_boundary);
+      result = sexp_stream_data_load(filename,task,fea_params,nodes,elements,
+                                     presc_boundary);
+    }
+    else if (!sp_istrcmp(ext_ptr, binary_ext))
+    {
+      result = binary_data_load(filename,task,fea_params,nodes,elements,
+                                presc_boundary);
     }
     if (result && *task)
     {
-      (*task)->export_file = (char*)malloc(strlen(filename));
+      (*task)->export_file = (char*)malloc(strlen(filename) +
+                                           sizeof(".msh"));
       sp_parse_file_basename(filename, (char*)(*task)->export_file);
       ext_ptr = (char*)(*task)->export_file + strlen((*task)->export_file);
       strcpy(ext_ptr,".msh");
@@ -11,6 +11,10 @@
 #include "defines.h"
 #include "sp_matrix.h"
 #include "sp_direct.h"
+#include "sp_iter.h"
+#include "amg.h"
+#include "bsr_matrix.h"
+#include "export_queue.h"
 #include "dense_matrix.h"
 #include "fea_model.h"
 
@@ -18,11 +22,55 @@
 #define MAX_ITERATIVE_TOLERANCE 1e-14
 /* default value of the max number of iterations for the iterative solvers */
 #define MAX_ITERATIVE_ITERATIONS 20000
+/*
+ * parameters of the Eisenstat-Walker forcing term (choice 2):
+ * eta_k = gamma*(|R_k|/|R_k-1|)^alpha, bounded by the default maximum
+ */
+#define FORCING_TERM_GAMMA 0.9
+#define FORCING_TERM_ALPHA 2.0
+#define FORCING_TERM_MAX 0.1
+/* default number of solves with the same ILU preconditioner */
+#define ILU_REFRESH_COUNT 10
+/*
+ * default growth factor of the number of PCG iterations relative to the
+ * first solve with the ILU preconditioner after which it is rebuilt
+ */
+#define ILU_REFRESH_FACTOR 2.0
+/*
+ * the line search stops when the residual projected to the Newton
+ * direction drops below this fraction of its value at the start
+ */
+#define LINESEARCH_TOLERANCE 0.5
+/*
+ * default bounds of the adaptive load increment, in fractions of the
+ * prescribed displacements of one load increment
+ */
+#define ADAPTIVE_MIN_INCREMENT 0.01
+#define ADAPTIVE_MAX_INCREMENT 10.0
+/* default desired number of Newton iterations per adaptive increment */
+#define ADAPTIVE_TARGET_NEWTON_COUNT 6
+/* reduction of the increment after a failed step */
+#define ADAPTIVE_CUTBACK 0.5
+/* maximum growth of the increment after a converged step */
+#define ADAPTIVE_MAX_GROWTH 2.0
+
+/*
+ * number of the last converged load steps kept in memory, enough for
+ * the quadratic predictor. Older steps are only in the export file
+ */
+#define LOAD_STEPS_HISTORY 3
+
+/* number of nodes in the TETRAHEDRA10 element */
+#define TETRAHEDRA10_NODES 10
+/* maximum number of gauss nodes supported for the TETRAHEDRA10 element */
+#define TETRAHEDRA10_MAX_GAUSS 5
 
 /*************************************************************/
 /* Forward declarations                                      */
 
 typedef struct fea_solver_tag* fea_solver_ptr;
+typedef struct nodes_array_tag* nodes_array_ptr;
+typedef struct load_step_tag* load_step_ptr;
 
 /*************************************************************/
 /* Function pointers declarations                            */
@@ -40,9 +88,30 @@ typedef real (*isoform_t)(int i,real r,real s,real t);
 typedef real (*disoform_t)(int shape,int dof,real r,real s,real t);
 
 /*
- * A pointer to the function for exporting data from solver
- */ 
-typedef void (*export_solution_t) (fea_solver_ptr, const char *filename);
+ * A pointer to the function for calculating gradients of the shape
+ * functions with respect to global coordinates in the gauss node
+ * of the element.
+ * grads - array [dof x nodes_per_element]
+ * detJ - determinant of Jacobi matrix
+ * Returns FALSE if the Jacobi matrix is ill-formed, grads are not
+ * changed in this case
+ */
+typedef BOOL (*shape_gradients_t)(fea_solver_ptr self,
+                                  nodes_array_ptr nodes,
+                                  int element,
+                                  int gauss,
+                                  real (*grads)[MAX_NODES_PER_ELEMENT],
+                                  real* detJ);
+
+/*
+ * Pointers to the functions of the streaming export of the solution.
+ * The open function creates the file and writes the mesh and
+ * the initial state, returns 0 on error.
+ * The step function appends the converged load step to the file
+ */
+typedef FILE* (*export_open_t) (fea_solver_ptr, const char *filename);
+typedef void (*export_step_t) (fea_solver_ptr, FILE* f,
+                               load_step_ptr step);
 
 /*
  * A pointer to the function for appling single BC for global
@@ -62,8 +131,39 @@ typedef enum  {
 typedef enum {
   CG,
   PCG_ILU,
-  CHOLESKY
+  CHOLESKY,
+  PCG_AMG
 } slae_solver_type;
+
+/* fill-reducing ordering of the global matrix for the direct solver */
+typedef enum {
+  ORDERING_NONE,                /* order of nodes in the input file */
+  ORDERING_MINIMUM_DEGREE,      /* exact minimum degree, the elimination
+                                 * graph keeps all fill edges, so only for
+                                 * small meshes */
+  ORDERING_NESTED_DISSECTION    /* geometric nested dissection */
+} ordering_type;
+
+/* preconditioner of the matrix-free CG */
+typedef enum {
+  PRECONDITIONER_NONE,
+  PRECONDITIONER_JACOBI,        /* inverse of the diagonal */
+  PRECONDITIONER_BLOCK_JACOBI   /* inverses of 3x3 diagonal blocks of nodes */
+} preconditioner_type;
+
+/* format of the export file */
+typedef enum {
+  EXPORT_GMSH_ASCII,            /* text Gmsh .msh 2.0, 6 decimals */
+  EXPORT_GMSH_BINARY            /* binary Gmsh .msh 2.0, full precision */
+} export_format_type;
+
+/* initial approximation of the nodes at the start of a load step */
+typedef enum {
+  PREDICTOR_NONE,               /* last converged state plus prescribed
+                                 * displacements */
+  PREDICTOR_LINEAR,             /* extrapolation of the last two states */
+  PREDICTOR_QUADRATIC           /* extrapolation of the last three states */
+} predictor_type;
   
 typedef enum  {
   /* TRIANGLE3, TRIANGLE6,TETRAHEDRA4, */
@@ -96,16 +196,52 @@ typedef struct {
   fea_model model;              /* material model */
   slae_solver_type solver_type; /* SLAE solver */
   real solver_tolerance;        /* tolerance in case of iterative solver */
+  BOOL inexact_newton;          /* relative tolerance of the iterative
+                                 * solver is the Eisenstat-Walker forcing
+                                 * term, solver_tolerance is the lower
+                                 * bound then */
+  real max_forcing_term;        /* upper bound of the forcing term */
   int solver_max_iter;          /* max number of iters for iterative solver */
+  ordering_type ordering;       /* ordering of unknowns for CHOLESKY */
+  int ilu_refresh_count;        /* rebuild ILU preconditioner after this
+                                 * number of solves, 1 - every solve */
+  real ilu_refresh_factor;      /* rebuild ILU preconditioner if the number
+                                 * of PCG iterations grows by this factor
+                                 * compared to the first solve with it */
+  amg_params amg;               /* parameters of the AMG preconditioner */
+  BOOL matrix_free;             /* CG applies the tangent element by
+                                 * element without the global matrix */
+  preconditioner_type preconditioner; /* preconditioner of the
+                                       * matrix-free CG */
   int dof;                      /* number of degree of freedom */
   element_type ele_type;        /* type of the element */
   int load_increments_count;    /* number of load increments */
   real desired_tolerance;       /* desired energy tolerance */
   int max_newton_count;         /* maximum number of Newton's iterations */
   int linesearch_max;           /* maximum number of line searches */
-  int arclength_max;            /* maximum number of arc lenght searches */
+  int arclength_max;            /* maximum number of arc-length steps,
+                                 * 0 - load increments are used */
   BOOL modified_newton;         /* use modified Newton's method or not */
+  int bfgs_max;                 /* maximum number of stored BFGS updates
+                                 * of the tangent kept for the load step,
+                                 * 0 - no updates */
+  BOOL adaptive_increments;     /* choose load increments by the number
+                                 * of Newton iterations, load_increments_count
+                                 * then sets the total load only */
+  real min_increment;           /* bounds of the adaptive load increment */
+  real max_increment;
+  int target_newton_count;      /* desired number of Newton iterations
+                                 * per adaptive increment */
+  predictor_type predictor;     /* predictor of the load step */
+  BOOL eliminate_prescribed;    /* exclude prescribed d.o.f. from the
+                                 * global system of equations */
+  int threads_count;            /* number of threads used in assembly */
   const char* export_file;      /* export file name - guessing from input */
+  export_format_type export_format; /* format of the export file */
+  void* mapped_data;            /* binary task file mapped to memory, the
+                                 * input arrays point into it, 0 if the
+                                 * task is not loaded from a binary file */
+  size_t mapped_size;
 } fea_task;
 typedef fea_task* fea_task_ptr;
 
@@ -121,20 +257,25 @@ typedef fea_solution_params* fea_solution_params_ptr;
 /* Input geometry parameters                                 */
 
 /* An array of nodes. */
-typedef struct {
+typedef struct nodes_array_tag {
   int nodes_count;      /* number of input nodes */
-  real **nodes;         /* nodes array,sized as nodes_count x MAX_DOF
-                         * so access is  nodes[node_number][dof] */
+  real (*nodes)[MAX_DOF]; /* nodes array, one contiguous block sized
+                           * as nodes_count x MAX_DOF
+                           * so access is  nodes[node_number][dof] */
+  BOOL mapped;          /* nodes point into the mapped task file and
+                         * shall not be deallocated */
 } nodes_array;
-typedef nodes_array* nodes_array_ptr;
 
 /* An array of elements */
 typedef struct {
   int elements_count;           /* number of elements */
-  int **elements;               /* elements array, each line represents an
-                                 * element. Element is an array of node
-                                 * indexes
-                                 */
+  int (*elements)[MAX_NODES_PER_ELEMENT]; /* elements array, one contiguous
+                                          * block, each line represents an
+                                          * element. Element is an array of
+                                          * node indexes
+                                          */
+  BOOL mapped;                  /* elements point into the mapped task
+                                 * file */
 } elements_array;
 typedef elements_array* elements_array_ptr;
 
@@ -153,6 +294,7 @@ typedef prescribed_bnd_node* prescribed_bnd_node_ptr;
 typedef struct {
   int prescribed_nodes_count;
   prescribed_bnd_node* prescribed_nodes;
+  BOOL mapped;                  /* nodes point into the mapped task file */
 } presc_bnd_array;
 typedef presc_bnd_array* presc_bnd_array_ptr;
 
@@ -181,6 +323,12 @@ typedef struct {
   real (*gauss_nodes_data)[4];  /* pointer to an array of gauss
                                  * coefficients and weights */  
   gauss_node_ptr *gauss_nodes;   /* Gauss nodes array */
+  /*
+   * derivatives of shape functions of the TETRAHEDRA10 element in
+   * gauss nodes with respect to d.o.f., the same as
+   * gauss_nodes[gauss]->dforms but with compile-time sizes
+   */
+  real tetrahedra10_dforms[TETRAHEDRA10_MAX_GAUSS][MAX_DOF][TETRAHEDRA10_NODES] ALIGNED(16);
 } elements_database;
 typedef elements_database* elements_database_ptr;
 
@@ -195,11 +343,13 @@ typedef elements_database* elements_database_ptr;
  *                  dX_i
  * 
  * X_1 = x, X_2 = y, X_3 = z coordinates
- * 
+ *
+ * Gradients for all elements and gauss nodes are stored in one
+ * preallocated array [number of elems x gauss nodes]
  */
 typedef struct {
-  real **grads;                  /* array of derivatives of shape functions
-                                  * [dof x nodes_per_element] */
+  /* array of derivatives of shape functions [dof x nodes_per_element] */
+  real grads[MAX_DOF][MAX_NODES_PER_ELEMENT] ALIGNED(16);
   real detJ;                     /* determinant of Jacobi matrix */
 } shape_gradients;
 typedef shape_gradients* shape_gradients_ptr;
@@ -209,19 +359,20 @@ typedef shape_gradients* shape_gradients_ptr;
  * This structure holds all information needed on the current
  * load increment step
  */
-typedef struct {
+typedef struct load_step_tag {
   int step_number;
+  real load;                    /* multiplier of prescribed displacements
+                                 * of one increment reached at the step */
   nodes_array_ptr nodes_p;      /* nodes in current configuration for step */
-  tensor **graddefs;            /* Components of Deformation gradient tensor
+  tensor *graddefs;             /* Components of Deformation gradient tensor
                                  * in gauss nodes
-                                 * array [number of elems] x [gauss nodes]
+                                 * array [number of elems x gauss nodes]
                                  */
-  tensor **stresses;            /* Components of Cauchy stress tensor
+  tensor *stresses;             /* Components of Cauchy stress tensor
                                  * in gauss nodes
-                                 * array [number of elems] x [gauss nodes]
+                                 * array [number of elems x gauss nodes]
                                  */
 } load_step;
-typedef load_step* load_step_ptr;
 
 /*
  * A main application structure which shall contain all
@@ -232,7 +383,15 @@ typedef struct fea_solver_tag {
                                    * shape function */
   isoform_t shape;                /* a function pointer to the shape
                                    * function */
-  export_solution_t export_function; /* a pointer to the export function */
+  shape_gradients_t shape_gradients_func; /* a function pointer to the
+                                           * calculation of the shape
+                                           * functions gradients */
+  export_open_t export_open;     /* functions of the streaming export */
+  export_step_t export_step;
+  FILE* export_stream;          /* export file with written load steps
+                                 * or 0 */
+  export_queue_ptr export_queue; /* writer thread of the export, load steps
+                                  * are written synchronously if 0 */
 
   fea_task_ptr task_p;               
   fea_solution_params_ptr fea_params_p; 
@@ -244,39 +403,102 @@ typedef struct fea_solver_tag {
                                    * values of derivatives of the
                                    * isoparametric shape functions
                                    * in gauss nodes */
-  shape_gradients_ptr **shape_gradients0; /* an array of gradients of
-                                           * shape functios per element
-                                           * per gauss node in initial
-                                           * configuration
-                                           * [number of elems] x [gauss nodes]  
-                                           */
-  shape_gradients_ptr **shape_gradients; /* an array of gradients of
-                                          * shape functios per element
-                                          * per gauss node in current
-                                          * configuration
-                                          * [number of elems] x [gauss nodes]
-                                          * shall be calculated after update of
-                                          * nodes
-                                          */
-
-  tensor **graddefs;            /* Components of Deformation gradient tensor
+  shape_gradients_ptr shape_gradients0; /* an array of gradients of
+                                         * shape functios per element
+                                         * per gauss node in initial
+                                         * configuration
+                                         * [number of elems x gauss nodes]
+                                         */
+  shape_gradients_ptr shape_gradients; /* an array of gradients of
+                                        * shape functios per element
+                                        * per gauss node in current
+                                        * configuration
+                                        * [number of elems x gauss nodes]
+                                        * shall be calculated after update of
+                                        * nodes
+                                        */
+
+  tensor *graddefs;             /* Components of Deformation gradient tensor
                                  * in gauss nodes
-                                 * array [number of elems] x [gauss nodes]
+                                 * array [number of elems x gauss nodes]
                                  */
-  tensor **stresses;            /* Components of Cauchy stress tensor
+  tensor *stresses;             /* Components of Cauchy stress tensor
                                  * in gauss nodes
-                                 * array [number of elems] x [gauss nodes]
+                                 * array [number of elems x gauss nodes]
                                  */
-  int current_load_step;
-  load_step_ptr load_steps_p;   /* an array of stored load steps data
-                                 * array size is task_p->load_increments_count
-                                 * load_steps_p[0..current_load_step] shall be
-                                 * filled during load steps iterations
+  int current_load_step;        /* number of converged load steps */
+  load_step_ptr load_steps_p;   /* the last converged load steps,
+                                 * ring buffer of LOAD_STEPS_HISTORY
+                                 * elements: step i is stored in
+                                 * load_steps_p[i % LOAD_STEPS_HISTORY].
+                                 * Use solver_load_step to access
                                  */
+  int* equations;               /* index of the equation in the global
+                                 * system for every global d.o.f.,
+                                 * -1 for eliminated prescribed d.o.f.
+                                 * [number of nodes x dof] */
+  int equations_count;          /* size of the global system */
   sp_matrix global_mtx;         /* global stiffness matrix */
+  BOOL block_storage;           /* TRUE if the global stiffness matrix
+                                 * is stored in global_bsr by 3x3 blocks
+                                 * of nodes instead of global_mtx.
+                                 * Used by CG and PCG_AMG solvers */
+  bsr_matrix global_bsr;        /* global stiffness matrix in the block
+                                 * storage, eliminated prescribed d.o.f.
+                                 * are kept as decoupled equations */
+  real (*tangents)[VOIGT_SIZE][VOIGT_SIZE]; /* material tangents D in
+                                            * gauss nodes for the
+                                            * matrix-free operator
+                                            * [elems x gauss nodes] */
+  real (*node_blocks)[MAX_DOF*MAX_DOF]; /* inverted diagonal blocks (or
+                                         * diagonal) of the tangent for the
+                                         * matrix-free preconditioner
+                                         * [number of nodes] */
+  int* stiffness_map;           /* offsets of local stiffness matrices
+                                 * components in the global stiffness
+                                 * matrix values arrays
+                                 * [number of elems] x [size x size] */
+  int colors_count;             /* number of colors of elements */
+  int* colors_offsets;          /* offsets of colors in colored_elements
+                                 * array, [colors_count + 1] */
+  int* colored_elements;        /* elements indexes sorted by colors.
+                                 * Elements of the same color do not
+                                 * share nodes, so they could be assembled
+                                 * in parallel */
   sp_chol_symbolic_ptr symb_chol; /* symbolic Cholesky decomposition
                                    * of the global stiffness matrix
                                    */
+  sp_matrix_skyline_ilu_ptr ilu; /* cached ILU preconditioner of the
+                                  * global stiffness matrix */
+  int ilu_solves;               /* number of solves with the cached ILU */
+  int ilu_base_iter;            /* number of PCG iterations in the first
+                                 * solve with the cached ILU at the
+                                 * tolerance ilu_base_tolerance */
+  real ilu_base_tolerance;
+  int* chol_perm;               /* fill-reducing permutation of the global
+                                 * d.o.f. for the Cholesky decomposition,
+                                 * chol_perm[new index] = old index */
+  amg_hierarchy_ptr amg;        /* AMG hierarchy of the global stiffness
+                                 * matrix, valid until the next assembly
+                                 * of the matrix */
+  sp_matrix_yale_ptr chol_factor; /* numeric Cholesky factor L of the
+                                   * global stiffness matrix with applied
+                                   * boundary conditions, valid until
+                                   * the next assembly of the matrix
+                                   */
+  real* bfgs_s;                 /* BFGS pairs of nodes steps s and */
+  real* bfgs_y;                 /* residual changes y, [bfgs_max x size],
+                                 * 0 if BFGS is not used */
+  real* bfgs_rho;               /* 1/<y,s> of pairs */
+  real* bfgs_alpha;             /* work array of the two-loop recursion */
+  real* bfgs_forces;            /* residual forces at the start of the
+                                 * last step */
+  int bfgs_count;               /* number of complete pairs */
+  real forcing_term;            /* relative tolerance of the next
+                                 * iterative solve in inexact Newton,
+                                 * 0 - solver_tolerance is used */
+  real residual_norm;           /* norm of the residual forces of the
+                                 * last Newton iteration */
   real* global_forces_vct;      /* external forces vector */
   real* global_reactions_vct;   /* reactions in fixed dofs */
   real* global_solution_vct;    /* vector of global solution */
@@ -347,17 +569,26 @@ presc_bnd_array_ptr presc_bnd_array_free(presc_bnd_array_ptr presc);
 fea_solver_ptr fea_solver_free(fea_solver_ptr solver);
 
 /*
- * Constructor for the shape functions gradients array
- * element - index of the element to calculate in
- * gauss - index of gauss node
+ * Returns the shape functions gradients in the gauss node of the element
+ * from the array self->shape_gradients or self->shape_gradients0
+ * depending on flag current
+ */
+shape_gradients_ptr solver_shape_gradients(fea_solver_ptr self,
+                                           BOOL current,
+                                           int element,
+                                           int gauss);
+
+/*
+ * Generic function for calculating gradients of the shape functions
+ * in the gauss node of the element for any element type.
+ * See shape_gradients_t for description of parameters
  */
-shape_gradients_ptr solver_shape_gradients_alloc(fea_solver_ptr self,
-                                                 nodes_array_ptr nodes,
-                                                 int element,
-                                                 int gauss);
-/* Destructor for the shape gradients array */
-shape_gradients_ptr solver_shape_gradients_free(fea_solver_ptr self,
-                                                shape_gradients_ptr grads);
+BOOL solver_shape_gradients_generic(fea_solver_ptr self,
+                                    nodes_array_ptr nodes,
+                                    int element,
+                                    int gauss,
+                                    real (*grads)[MAX_NODES_PER_ELEMENT],
+                                    real* detJ);
 
 /*
  * fills the self->shape_gradients or self->shape_gradients0 array
@@ -386,6 +617,12 @@ void solver_load_step_init(fea_solver_ptr self,
                            load_step_ptr step,
                            int step_number);
             
+/*
+ * Converged load step with the number step if it is still kept in
+ * memory, 0 otherwise
+ */
+load_step_ptr solver_load_step(fea_solver_ptr self, int step);
+
 /*
  * Desctructor for the load step structure.
  * it doesn't deallocate a memory for a step itself,
@@ -439,11 +676,40 @@ real tetrahedra10_df_dt(int i, real r, real s, real t);
  */
 real tetrahedra10_disoform(int shape,int dof,real r,real s,real t);
 
+/*
+ * Specialized version of the solver_shape_gradients_generic for the
+ * TETRAHEDRA10 element with compile-time sizes.
+ * See shape_gradients_t for description of parameters
+ */
+BOOL tetrahedra10_shape_gradients(fea_solver_ptr self,
+                                  nodes_array_ptr nodes,
+                                  int element,
+                                  int gauss,
+                                  real (*grads)[MAX_NODES_PER_ELEMENT],
+                                  real* detJ);
+
 
 /*************************************************************/
 /* Functions for exporting data in different formats         */
-void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver,
-                                     const char *filename);
+
+/*
+ * Gmsh export of TETRAHEDRA10 meshes, see export_open_t and
+ * export_step_t. The step 0 is the initial state
+ */
+FILE* solver_export_tetrahedra10_gmsh_open(fea_solver_ptr solver,
+                                           const char *filename);
+void solver_export_tetrahedra10_gmsh_step(fea_solver_ptr solver, FILE* f,
+                                          load_step_ptr step);
+
+/*
+ * Binary Gmsh export of TETRAHEDRA10 meshes with values written as
+ * doubles, see export_open_t and export_step_t
+ */
+FILE* solver_export_tetrahedra10_gmsh_binary_open(fea_solver_ptr solver,
+                                                  const char *filename);
+void solver_export_tetrahedra10_gmsh_binary_step(fea_solver_ptr solver,
+                                                 FILE* f,
+                                                 load_step_ptr step);
 
 
 /*************************************************************/
@@ -451,14 +717,25 @@ void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver,
 
 /*
  * Parse command line parameters and return input file name
- * into the filename variable
+ * into the filename variable. The export format given in the command
+ * line is returned into the format variable, -1 if not given.
+ * The name of the binary task file to convert the input to is returned
+ * into the convert variable, 0 if not given
+ */
+int parse_cmdargs(int argc, char **argv,char **filename, int* format,
+                  char **convert);
+
+/*
+ * Real main function with input filename as a parameter.
+ * format overrides the export format of the task if not -1
  */
-int parse_cmdargs(int argc, char **argv,char **filename);
+int do_main(char* filename, int format);
 
 /*
- * Real main function with input filename as a parameter
+ * Load the input file and write it as the binary task file output
+ * without solving the task
  */
-int do_main(char* filename);
+int do_convert(char* filename, char* output);
 
 
 /*
@@ -471,11 +748,62 @@ void solve(fea_task_ptr task,
            elements_array_ptr elements,
            presc_bnd_array_ptr presc_boundary);
 
+/*
+ * Newton iterations for the current load increment, prescribed
+ * displacements shall be already applied to nodes.
+ * Returns TRUE if converged, the number of performed iterations
+ * is stored to iterations
+ */
+BOOL solver_newton_iterations(fea_solver_ptr solver, int* iterations);
+
+/*
+ * Increment loop with the multiplier of prescribed displacements
+ * growing by load increments, fixed or adaptive
+ */
+void solver_load_control_steps(fea_solver_ptr solver);
+
+/*
+ * Increment loop following the equilibrium path with the arc-length
+ * method: the multiplier of prescribed displacements is an unknown
+ * of every step, the step length is the norm of nodal displacements.
+ * The last step is a load increment reaching the total load exactly
+ */
+void solver_arc_length_steps(fea_solver_ptr solver);
+
+/*
+ * Newton iterations of the arc-length step from the converged state.
+ * delta on input is the displacements of the previous step, which
+ * set the direction of the predictor, and on output of this step.
+ * length is the arc length, computed from the tangent of one load
+ * increment if 0. The found increment of the load multiplier is
+ * stored to dlambda.
+ * Returns TRUE if converged, the number of performed iterations
+ * is stored to iterations
+ */
+BOOL solver_arc_length_iterations(fea_solver_ptr solver,
+                                  real* delta, real* length,
+                                  real* dlambda, int* iterations);
+
 /*
  * Solver wrapper function to solve SLAE
  */
 BOOL solver_solve_slae(fea_solver_ptr solver);
 
+/*
+ * Create numbering of equations solver->equations for all global d.o.f.
+ * If task_p->eliminate_prescribed is set the prescribed d.o.f. are
+ * left out of the global system
+ */
+void solver_create_equations(fea_solver_ptr self);
+
+/*
+ * Create a fill-reducing permutation solver->chol_perm of the global
+ * d.o.f. using the algorithm task_p->ordering. The ordering is
+ * calculated for the graph of nodes, so all d.o.f. of a node
+ * are kept together
+ */
+void solver_create_ordering(fea_solver_ptr self);
+
 #ifdef DUMP_DATA
 /* Dump input data to check if parser works correctly */
 void dump_input_data( char* filename,
@@ -520,19 +848,34 @@ void solver_create_stresses(fea_solver_ptr self);
 /* Create global residual forces vector */
 void solver_create_residual_forces(fea_solver_ptr self);
 
+/*
+ * Partition elements into colors, sets of elements without
+ * shared nodes. Fills self->colors_offsets and self->colored_elements
+ */
+void solver_create_elements_colors(fea_solver_ptr self);
+
 /* Create global stiffness matrix */
 void solver_create_stiffness(fea_solver_ptr self);
 
+/*
+ * Create sparsity pattern of the global stiffness matrix from the
+ * elements connectivity and fill the self->stiffness_map with offsets
+ * of the local stiffness components in the global matrix.
+ * Since the connectivity never changes this is done only once
+ */
+void solver_create_stiffness_pattern(fea_solver_ptr self);
+
 
 /* Update global forces vector with residual forces for the element */
 void solver_local_residual_forces(fea_solver_ptr self,int element);
 
 
-/* Create constitutive component of the stiffness matrix */
-void solver_local_constitutive_part(fea_solver_ptr self,int element);
-
-/* Create initial stress component of the stiffness matrix */
-void solver_local_initial_stess_part(fea_solver_ptr self,int element);
+/*
+ * Create local stiffness matrix of the element - constitutive and
+ * initial stress components together - and distribute it to the
+ * global stiffness matrix
+ */
+void solver_local_stiffness(fea_solver_ptr self,int element);
 
 
 /*
@@ -587,6 +930,28 @@ void solver_apply_bc_general(fea_solver_ptr self,
 void solver_apply_single_bc(fea_solver_ptr self,
                             int index, real value);
 
+/*
+ * Apply BC in form of prescribed displacements to the global forces
+ * vector only. Used when the global stiffness matrix already has
+ * boundary conditions applied, as in modified Newton iterations
+ * lambda - multiplier for the prescribed displacements
+ */
+void solver_apply_prescribed_bc_forces(fea_solver_ptr self,real lambda);
+
+/* Apply BC in form of prescribed displacement to a single specified
+ * global d.o.f. of the global forces vector only.
+ * This function is called from solver_apply_prescribed_bc_forces
+ */
+void solver_apply_single_bc_forces(fea_solver_ptr self,
+                                   int index, real value);
+
+/*
+ * Cancellation of the row and column 'index' of the global stiffness
+ * matrix keeping its sparsity pattern.
+ * Returns the diagonal element
+ */
+real solver_matrix_cross_cancellation(fea_solver_ptr self, int index);
+
 /* Add BC in form of prescribed displacements to a single specified
  * global d.o.f. of a global nodes vector
  * This function is called from solver_update_nodes_with_bc */
@@ -609,6 +974,26 @@ void solver_update_nodes_with_solution(fea_solver_ptr self,
  */
 void solver_update_nodes_with_bc(fea_solver_ptr self, real lambda);
 
+/*
+ * Move nodes to the start of the next load step by the polynomial
+ * extrapolation of converged states (the initial one and stored load
+ * steps) in the load multiplier. Prescribed d.o.f. are linear in the
+ * load, so they get exactly increment times prescribed displacements.
+ * Returns FALSE and keeps nodes if the predictor is not used or there
+ * are no converged steps yet
+ */
+BOOL solver_predict_nodes(fea_solver_ptr self, real increment);
+
+/*
+ * Energy-based line search along the Newton direction
+ * solver->global_solution_vct, called after the nodes were updated
+ * with the full step. r0 is the projection of the residual forces on
+ * the direction at the start of the step.
+ * Moves nodes to the found step, recreating shape gradients and stresses,
+ * and scales the solution vector by it. Returns the step multiplier
+ */
+real solver_line_search(fea_solver_ptr self, real r0);
+
 /*
  * Creates a particular gauss node for the element
  * with index element_index and gauss node number gauss_node_index
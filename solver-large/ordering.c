@@ -0,0 +1,314 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <stdlib.h>
+#include <string.h>
+#include "defines.h"
+#include "ordering.h"
+
+/* sets of vertices of this size are not dissected anymore */
+#define ND_LEAF_SIZE 64
+
+
+/*************************************************************/
+/* Minimum degree ordering                                   */
+
+/* An element of the priority queue of vertices */
+typedef struct {
+  int degree;
+  int vertex;
+} degree_node;
+
+/* Binary heap of vertices ordered by degree and then by index */
+typedef struct {
+  degree_node* nodes;
+  int count;
+  int capacity;
+} degree_heap;
+
+static BOOL degree_less(degree_node* a, degree_node* b)
+{
+  return a->degree < b->degree ||
+    (a->degree == b->degree && a->vertex < b->vertex);
+}
+
+static void degree_heap_push(degree_heap* heap, int degree, int vertex)
+{
+  int i,parent;
+  degree_node node;
+  if (heap->count == heap->capacity)
+  {
+    heap->capacity *= 2;
+    heap->nodes = (degree_node*)realloc(heap->nodes,
+                                        sizeof(degree_node)*heap->capacity);
+  }
+  node.degree = degree;
+  node.vertex = vertex;
+  /* sift up */
+  for (i = heap->count ++; i > 0; i = parent)
+  {
+    parent = (i-1)/2;
+    if (!degree_less(&node,&heap->nodes[parent]))
+      break;
+    heap->nodes[i] = heap->nodes[parent];
+  }
+  heap->nodes[i] = node;
+}
+
+static degree_node degree_heap_pop(degree_heap* heap)
+{
+  int i,child;
+  degree_node top = heap->nodes[0];
+  degree_node last = heap->nodes[-- heap->count];
+  /* sift down */
+  for (i = 0; (child = 2*i+1) < heap->count; i = child)
+  {
+    if (child + 1 < heap->count &&
+        degree_less(&heap->nodes[child+1],&heap->nodes[child]))
+      child ++;
+    if (!degree_less(&heap->nodes[child],&last))
+      break;
+    heap->nodes[i] = heap->nodes[child];
+  }
+  heap->nodes[i] = last;
+  return top;
+}
+
+void ordering_minimum_degree(int n, int* xadj, int* adj, int* perm)
+{
+  /* adjacency lists of the elimination graph */
+  int** lists = (int**)malloc(sizeof(int*)*n);
+  int* degree = (int*)malloc(sizeof(int)*n);
+  int* capacity = (int*)malloc(sizeof(int)*n);
+  int* mark = (int*)calloc(n,sizeof(int));
+  BOOL* eliminated = (BOOL*)calloc(n,sizeof(BOOL));
+  int stamp = 0;
+  int i,j,k,u,v,w;
+  degree_heap heap;
+  degree_node top;
+
+  heap.capacity = n > 0 ? 2*n : 1;
+  heap.count = 0;
+  heap.nodes = (degree_node*)malloc(sizeof(degree_node)*heap.capacity);
+
+  for (i = 0; i < n; ++ i)
+  {
+    degree[i] = xadj[i+1] - xadj[i];
+    capacity[i] = degree[i] > 0 ? degree[i] : 1;
+    lists[i] = (int*)malloc(sizeof(int)*capacity[i]);
+    memcpy(lists[i],adj + xadj[i],sizeof(int)*degree[i]);
+    degree_heap_push(&heap,degree[i],i);
+  }
+
+  for (k = 0; k < n; )
+  {
+    top = degree_heap_pop(&heap);
+    v = top.vertex;
+    /* skip outdated entries of the queue */
+    if (eliminated[v] || top.degree != degree[v])
+      continue;
+    perm[k++] = v;
+    eliminated[v] = TRUE;
+    /*
+     * eliminate v: all its neighbors become pairwise connected
+     * in the elimination graph
+     */
+    for (i = 0; i < degree[v]; ++ i)
+    {
+      u = lists[v][i];
+      /* remove v from the list of u and mark the rest */
+      stamp ++;
+      mark[u] = stamp;
+      for (j = 0; j < degree[u]; )
+      {
+        if (lists[u][j] == v)
+          lists[u][j] = lists[u][-- degree[u]];
+        else
+          mark[lists[u][j++]] = stamp;
+      }
+      /* add the rest of neighbors of v */
+      for (j = 0; j < degree[v]; ++ j)
+      {
+        w = lists[v][j];
+        if (mark[w] == stamp)
+          continue;
+        if (degree[u] == capacity[u])
+        {
+          capacity[u] *= 2;
+          lists[u] = (int*)realloc(lists[u],sizeof(int)*capacity[u]);
+        }
+        lists[u][degree[u]++] = w;
+        mark[w] = stamp;
+      }
+      degree_heap_push(&heap,degree[u],u);
+    }
+    free(lists[v]);
+    lists[v] = (int*)0;
+  }
+
+  free(heap.nodes);
+  free(eliminated);
+  free(mark);
+  free(capacity);
+  free(degree);
+  free(lists);
+}
+
+
+/*************************************************************/
+/* Nested dissection ordering                                */
+
+/* Data shared by all levels of dissection */
+typedef struct {
+  int* xadj;
+  int* adj;
+  real (*coords)[MAX_DOF];
+  int* side;                    /* part of the vertex in the current set:
+                                 * 0 - not in set, 1 - left, 2 - right,
+                                 * 3 - separator */
+} dissection_data;
+
+/*
+ * Rearrange set so what the vertex with the coordinate 'axis' of
+ * rank k is in set[k], vertices before it have smaller or equal
+ * coordinates and after it - greater or equal
+ */
+static void dissection_select(real (*coords)[MAX_DOF], int axis,
+                              int* set, int count, int k)
+{
+  int left = 0, right = count - 1;
+  int i,j,tmp;
+  real pivot;
+  while (left < right)
+  {
+    pivot = coords[set[(left + right)/2]][axis];
+    i = left;
+    j = right;
+    while (i <= j)
+    {
+      while (coords[set[i]][axis] < pivot) i ++;
+      while (coords[set[j]][axis] > pivot) j --;
+      if (i <= j)
+      {
+        tmp = set[i]; set[i] = set[j]; set[j] = tmp;
+        i ++;
+        j --;
+      }
+    }
+    if (k <= j)
+      right = j;
+    else if (k >= i)
+      left = i;
+    else
+      break;
+  }
+}
+
+/* number of vertices of the part 'from' connected to the part 'to' */
+static int dissection_boundary(dissection_data* data,
+                               int* set, int count, int from, int to,
+                               BOOL mark)
+{
+  int i,j,boundary = 0;
+  for (i = 0; i < count; ++ i)
+  {
+    if (data->side[set[i]] != from)
+      continue;
+    for (j = data->xadj[set[i]]; j < data->xadj[set[i]+1]; ++ j)
+      if (data->side[data->adj[j]] == to)
+      {
+        boundary ++;
+        if (mark)
+          data->side[set[i]] = 3;
+        break;
+      }
+  }
+  return boundary;
+}
+
+/*
+ * Order 'count' vertices of the set writing them to the output
+ * array 'out' in the order of elimination
+ */
+static void dissection_recursive(dissection_data* data,
+                                 int* set, int count, int* out)
+{
+  real lower[MAX_DOF],upper[MAX_DOF];
+  int i,j,axis,half,left,right,separator;
+  int* parts;
+
+  if (count <= ND_LEAF_SIZE)
+  {
+    memcpy(out,set,sizeof(int)*count);
+    return;
+  }
+  /* find the longest side of the bounding box */
+  for (j = 0; j < MAX_DOF; ++ j)
+    lower[j] = upper[j] = data->coords[set[0]][j];
+  for (i = 1; i < count; ++ i)
+    for (j = 0; j < MAX_DOF; ++ j)
+    {
+      if (data->coords[set[i]][j] < lower[j])
+        lower[j] = data->coords[set[i]][j];
+      if (data->coords[set[i]][j] > upper[j])
+        upper[j] = data->coords[set[i]][j];
+    }
+  axis = 0;
+  for (j = 1; j < MAX_DOF; ++ j)
+    if (upper[j] - lower[j] > upper[axis] - lower[axis])
+      axis = j;
+  /* bisect by the median */
+  half = count/2;
+  dissection_select(data->coords,axis,set,count,half);
+  for (i = 0; i < count; ++ i)
+    data->side[set[i]] = i < half ? 1 : 2;
+  /* the smallest boundary of both parts is a separator */
+  if (dissection_boundary(data,set,count,1,2,FALSE) <=
+      dissection_boundary(data,set,count,2,1,FALSE))
+    dissection_boundary(data,set,count,1,2,TRUE);
+  else
+    dissection_boundary(data,set,count,2,1,TRUE);
+
+  /* gather parts: left, right, separator */
+  parts = (int*)malloc(sizeof(int)*count);
+  left = right = separator = 0;
+  for (i = 0; i < count; ++ i)
+  {
+    if (data->side[set[i]] == 1) left ++;
+    else if (data->side[set[i]] == 2) right ++;
+  }
+  separator = left + right;
+  right = left;
+  left = 0;
+  for (i = 0; i < count; ++ i)
+  {
+    switch (data->side[set[i]])
+    {
+    case 1: parts[left++] = set[i]; break;
+    case 2: parts[right++] = set[i]; break;
+    default: parts[separator++] = set[i]; break;
+    }
+    data->side[set[i]] = 0;
+  }
+  /* separator is numbered last */
+  memcpy(out + right, parts + right, sizeof(int)*(count - right));
+  dissection_recursive(data,parts,left,out);
+  dissection_recursive(data,parts + left,right - left,out + left);
+  free(parts);
+}
+
+void ordering_nested_dissection(int n, int* xadj, int* adj,
+                                real (*coords)[MAX_DOF],
+                                int* perm)
+{
+  int i;
+  int* set = (int*)malloc(sizeof(int)*n);
+  dissection_data data;
+  data.xadj = xadj;
+  data.adj = adj;
+  data.coords = coords;
+  data.side = (int*)calloc(n,sizeof(int));
+  for (i = 0; i < n; ++ i)
+    set[i] = i;
+  dissection_recursive(&data,set,n,perm);
+  free(data.side);
+  free(set);
+}
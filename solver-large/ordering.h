@@ -0,0 +1,38 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __ORDERING_H__
+#define __ORDERING_H__
+
+#include "defines.h"
+
+/*************************************************************/
+/* Fill-reducing orderings of the symmetric sparse matrices  */
+
+/*
+ * All functions work with the adjacency graph of the matrix stored in
+ * the compressed form: neighbors of the vertex i are
+ * adj[xadj[i]..xadj[i+1]-1], the vertex itself is not in the list.
+ * The result is a permutation perm[new index] = old index
+ */
+
+/*
+ * Minimum degree ordering: on every step eliminates the vertex
+ * with the smallest number of neighbors in the elimination graph.
+ * Ties are resolved by the smallest vertex index.
+ * The elimination graph is explicit, the cost grows as the sum of
+ * squared degrees with fill, use nested dissection for large meshes
+ */
+void ordering_minimum_degree(int n, int* xadj, int* adj, int* perm);
+
+/*
+ * Nested dissection ordering based on the coordinates of vertices.
+ * The set of vertices is recursively bisected by the median plane
+ * orthogonal to the longest side of the bounding box, the separator
+ * is formed by vertices of one part connected to the other part and
+ * numbered after both parts.
+ * coords - array [n x MAX_DOF] of coordinates of vertices
+ */
+void ordering_nested_dissection(int n, int* xadj, int* adj,
+                                real (*coords)[MAX_DOF],
+                                int* perm);
+
+#endif /* __ORDERING_H__ */
@@ -0,0 +1,73 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defines.h"
+#include "dense_matrix.h"
+#include "pcg.h"
+
+
+int pcg_solve(int n,
+              linear_operator_t op, void* op_data,
+              linear_operator_t prec, void* prec_data,
+              real* b, real* x,
+              int max_iter, real* tolerance)
+{
+  real* r = (real*)malloc(sizeof(real)*n);
+  real* z = (real*)malloc(sizeof(real)*n);
+  real* p = (real*)malloc(sizeof(real)*n);
+  real* q = (real*)malloc(sizeof(real)*n);
+  real rz,rz_new,alpha,beta,norm_b,norm_r;
+  int i,iter = 0;
+
+  /* r = b - A*x */
+  op(op_data,x,q);
+  for (i = 0; i < n; ++ i)
+    r[i] = b[i] - q[i];
+  norm_b = vector_norm(b,n);
+  if (norm_b == 0)
+    norm_b = 1;
+  norm_r = vector_norm(r,n);
+
+  if (norm_r/norm_b > *tolerance)
+  {
+    /* z = M^-1 r */
+    if (prec)
+      prec(prec_data,r,z);
+    else
+      memcpy(z,r,sizeof(real)*n);
+    memcpy(p,z,sizeof(real)*n);
+    rz = cdot(r,z,n);
+    for (iter = 1; iter <= max_iter; ++ iter)
+    {
+      op(op_data,p,q);
+      alpha = rz/cdot(p,q,n);
+      for (i = 0; i < n; ++ i)
+      {
+        x[i] += alpha*p[i];
+        r[i] -= alpha*q[i];
+      }
+      norm_r = vector_norm(r,n);
+      if (norm_r/norm_b <= *tolerance)
+        break;
+      if (prec)
+        prec(prec_data,r,z);
+      else
+        memcpy(z,r,sizeof(real)*n);
+      rz_new = cdot(r,z,n);
+      beta = rz_new/rz;
+      rz = rz_new;
+      for (i = 0; i < n; ++ i)
+        p[i] = z[i] + beta*p[i];
+    }
+    if (iter > max_iter)
+      iter = max_iter;
+  }
+  *tolerance = norm_r/norm_b;
+
+  free(q);
+  free(p);
+  free(z);
+  free(r);
+  return iter;
+}
@@ -0,0 +1,35 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __PCG_H__
+#define __PCG_H__
+
+#include "defines.h"
+
+/*************************************************************/
+/* Preconditioned conjugate gradient method                  */
+
+/*
+ * A pointer to the function applying a linear operator: y = A*x
+ * data - operator-specific data passed to pcg_solve
+ */
+typedef void (*linear_operator_t)(void* data, real* x, real* y);
+
+/*
+ * Solve the symmetric positive definite system A*x = b with the
+ * preconditioned conjugate gradient method.
+ * n - size of the system
+ * op, op_data - operator A
+ * prec, prec_data - preconditioner: y = M^-1 * x, shall be symmetric
+ * positive definite. If prec is 0 no preconditioning is used
+ * x - initial approximation on input, solution on output
+ * max_iter - maximum number of iterations
+ * tolerance - on input desired relative residual |r|/|b|,
+ * on output achieved one
+ * Returns the number of performed iterations
+ */
+int pcg_solve(int n,
+              linear_operator_t op, void* op_data,
+              linear_operator_t prec, void* prec_data,
+              real* b, real* x,
+              int max_iter, real* tolerance);
+
+#endif /* __PCG_H__ */
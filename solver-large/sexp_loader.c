@@ -1,6 +1,10 @@
 /* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
 
+/* fmemopen */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -91,6 +95,53 @@ static void process_solution(sexp_item* item, parse_data* data)
     data->task->modified_newton = TRUE;
   value = sexp_item_attribute(item,"max-newton-count");
   data->task->max_newton_count = sexp_item_inumber(value);
+  /* automatic load increments control */
+  value = sexp_item_attribute(item,"adaptive-increments");
+  if (value)
+    data->task->adaptive_increments =
+      sexp_item_is_symbol_like(value,"YES") ||
+      sexp_item_is_symbol_like(value,"TRUE");
+  value = sexp_item_attribute(item,"min-increment");
+  if (value)
+    data->task->min_increment = sexp_item_fnumber(value);
+  value = sexp_item_attribute(item,"max-increment");
+  if (value)
+    data->task->max_increment = sexp_item_fnumber(value);
+  value = sexp_item_attribute(item,"target-newton-count");
+  if (value)
+    data->task->target_newton_count = sexp_item_inumber(value);
+  /* extrapolation of converged steps to the start of the next one */
+  value = sexp_item_attribute(item,"predictor");
+  if (value)
+  {
+    if (sexp_item_is_symbol_like(value,"NONE"))
+      data->task->predictor = PREDICTOR_NONE;
+    else if (sexp_item_is_symbol_like(value,"LINEAR"))
+      data->task->predictor = PREDICTOR_LINEAR;
+    else if (sexp_item_is_symbol_like(value,"QUADRATIC"))
+      data->task->predictor = PREDICTOR_QUADRATIC;
+    else
+      printf("unknown predictor '%s'\n",sexp_item_symbol(value));
+  }
+  /* format of the export file */
+  value = sexp_item_attribute(item,"export-format");
+  if (value)
+  {
+    if (sexp_item_is_symbol_like(value,"ASCII"))
+      data->task->export_format = EXPORT_GMSH_ASCII;
+    else if (sexp_item_is_symbol_like(value,"BINARY"))
+      data->task->export_format = EXPORT_GMSH_BINARY;
+    else
+      printf("unknown export format '%s'\n",sexp_item_symbol(value));
+  }
+  value = sexp_item_attribute(item,"threads-count");
+  if (value)
+    data->task->threads_count = sexp_item_inumber(value);
+  value = sexp_item_attribute(item,"eliminate-prescribed");
+  if (value)
+    data->task->eliminate_prescribed =
+      sexp_item_is_symbol_like(value,"YES") ||
+      sexp_item_is_symbol_like(value,"TRUE");
 }
 
 static void process_slae_solver(sexp_item* item, parse_data* data)
@@ -101,6 +152,13 @@ static void process_slae_solver(sexp_item* item, parse_data* data)
   data->task->solver_type = CG;
   data->task->solver_tolerance = MAX_ITERATIVE_TOLERANCE;
   data->task->solver_max_iter = MAX_ITERATIVE_ITERATIONS;
+  data->task->ordering = ORDERING_NESTED_DISSECTION;
+  data->task->ilu_refresh_count = ILU_REFRESH_COUNT;
+  data->task->ilu_refresh_factor = ILU_REFRESH_FACTOR;
+  data->task->matrix_free = FALSE;
+  data->task->preconditioner = PRECONDITIONER_BLOCK_JACOBI;
+  data->task->inexact_newton = FALSE;
+  data->task->max_forcing_term = FORCING_TERM_MAX;
   if (value)
   {
     if (sexp_item_is_symbol_like(value,"CG"))
@@ -112,6 +170,24 @@ static void process_slae_solver(sexp_item* item, parse_data* data)
       value = sexp_item_attribute(item,"max-iterations");
       data->task->solver_max_iter = value ? sexp_item_inumber(value) :
         MAX_ITERATIVE_ITERATIONS;
+      /* element-by-element operator without the global matrix */
+      value = sexp_item_attribute(item,"matrix-free");
+      if (value)
+        data->task->matrix_free =
+          sexp_item_is_symbol_like(value,"YES") ||
+          sexp_item_is_symbol_like(value,"TRUE");
+      value = sexp_item_attribute(item,"preconditioner");
+      if (value)
+      {
+        if (sexp_item_is_symbol_like(value,"NONE"))
+          data->task->preconditioner = PRECONDITIONER_NONE;
+        else if (sexp_item_is_symbol_like(value,"JACOBI"))
+          data->task->preconditioner = PRECONDITIONER_JACOBI;
+        else if (sexp_item_is_symbol_like(value,"BLOCK-JACOBI"))
+          data->task->preconditioner = PRECONDITIONER_BLOCK_JACOBI;
+        else
+          printf("unknown preconditioner '%s'\n",sexp_item_symbol(value));
+      }
     }
     else if (sexp_item_is_symbol_like(value,"PCG_ILU"))
     {
@@ -122,16 +198,74 @@ static void process_slae_solver(sexp_item* item, parse_data* data)
       value = sexp_item_attribute(item,"max-iterations");
       data->task->solver_max_iter = value ? sexp_item_inumber(value) :
         MAX_ITERATIVE_ITERATIONS;
+      /* policy of rebuilding of the ILU preconditioner */
+      value = sexp_item_attribute(item,"ilu-refresh-count");
+      if (value)
+        data->task->ilu_refresh_count = sexp_item_inumber(value);
+      value = sexp_item_attribute(item,"ilu-refresh-factor");
+      if (value)
+        data->task->ilu_refresh_factor = sexp_item_fnumber(value);
     } 
+    else if (sexp_item_is_symbol_like(value,"PCG_AMG"))
+    {
+      data->task->solver_type = PCG_AMG;
+      value = sexp_item_attribute(item,"tolerance");
+      if (value)
+        data->task->solver_tolerance = sexp_item_fnumber(value);
+      value = sexp_item_attribute(item,"max-iterations");
+      data->task->solver_max_iter = value ? sexp_item_inumber(value) :
+        MAX_ITERATIVE_ITERATIONS;
+      /* setup and cycle parameters of the multigrid */
+      value = sexp_item_attribute(item,"amg-strength");
+      if (value)
+        data->task->amg.strength = sexp_item_fnumber(value);
+      value = sexp_item_attribute(item,"amg-coarse-size");
+      if (value)
+        data->task->amg.coarse_size = sexp_item_inumber(value);
+      value = sexp_item_attribute(item,"amg-max-levels");
+      if (value)
+        data->task->amg.max_levels = sexp_item_inumber(value);
+      value = sexp_item_attribute(item,"amg-smooth-steps");
+      if (value)
+        data->task->amg.smooth_steps = sexp_item_inumber(value);
+      value = sexp_item_attribute(item,"amg-omega");
+      if (value)
+        data->task->amg.prolongator_omega = sexp_item_fnumber(value);
+    }
     else if (sexp_item_is_symbol_like(value,"CHOLESKY"))
     {
       data->task->solver_type = CHOLESKY;
+      /* fill-reducing ordering */
+      value = sexp_item_attribute(item,"ordering");
+      if (value)
+      {
+        if (sexp_item_is_symbol_like(value,"NONE"))
+          data->task->ordering = ORDERING_NONE;
+        else if (sexp_item_is_symbol_like(value,"MINIMUM-DEGREE"))
+          data->task->ordering = ORDERING_NESTED_DISSECTION;
+        else if (sexp_item_is_symbol_like(value,"NESTED-DISSECTION"))
+          data->task->ordering = ORDERING_NESTED_DISSECTION;
+        else
+          printf("unknown ordering '%s'\n",sexp_item_symbol(value));
+      }
     } 
     else
     {
       printf("unknown solver type '%s'\n",sexp_item_symbol(value));
     }
   }
+  /* tolerance of iterative solvers following the Newton convergence */
+  if (data->task->solver_type != CHOLESKY)
+  {
+    value = sexp_item_attribute(item,"inexact-newton");
+    if (value)
+      data->task->inexact_newton =
+        sexp_item_is_symbol_like(value,"YES") ||
+        sexp_item_is_symbol_like(value,"TRUE");
+    value = sexp_item_attribute(item,"max-forcing-term");
+    if (value)
+      data->task->max_forcing_term = sexp_item_fnumber(value);
+  }
 }
 
 
@@ -166,6 +300,14 @@ static void process_arc_length(sexp_item* item, parse_data* data)
   data->task->arclength_max = sexp_item_inumber(value);
 }
 
+static void process_bfgs(sexp_item* item, parse_data* data)
+{
+  sexp_item* value;
+  value = sexp_item_attribute(item,"max");
+  assert(value);
+  data->task->bfgs_max = sexp_item_inumber(value);
+}
+
 static void process_nodes(sexp_item* item, parse_data* data)
 {
   int count = 0;
@@ -173,12 +315,11 @@ static void process_nodes(sexp_item* item, parse_data* data)
   sexp_item* next = sexp_item_cdr(item);
   count = sexp_item_length(item) - 1;
   data->nodes->nodes_count = count;
-  /* allocate storage for nodes */
+  /* allocate contiguous storage for nodes */
   data->nodes->nodes =
-    (real**)malloc(data->nodes->nodes_count*sizeof(real*));
+    (real(*)[MAX_DOF])malloc(data->nodes->nodes_count*MAX_DOF*sizeof(real));
   for (; i < data->nodes->nodes_count; ++ i)
   {
-    data->nodes->nodes[i] = (real*)malloc(MAX_DOF*sizeof(real));
     item = sexp_item_car(next);
     assert(sexp_item_length(item) == 3);
     data->nodes->nodes[i][0] = sexp_item_fnumber(sexp_item_nth(item,0));
@@ -195,13 +336,12 @@ static void process_elements(sexp_item* item, parse_data* data)
   sexp_item* next = sexp_item_cdr(item);
   count = sexp_item_length(item) - 1;
   data->elements->elements_count = count;
-  /* allocate storage for elements */
-  data->elements->elements = 
-    (int**)malloc(data->elements->elements_count*sizeof(int*));
+  assert(data->fea_params->nodes_per_element <= MAX_NODES_PER_ELEMENT);
+  /* allocate contiguous storage for elements */
+  data->elements->elements = (int(*)[MAX_NODES_PER_ELEMENT])
+    malloc(data->elements->elements_count*MAX_NODES_PER_ELEMENT*sizeof(int));
   for (; i < data->elements->elements_count; ++ i)
   {
-    data->elements->elements[i] =
-      (int*)malloc(data->fea_params->nodes_per_element*sizeof(int));
     item = sexp_item_car(next);
     assert(sexp_item_length(item) == data->fea_params->nodes_per_element);
     for ( j = 0; j < data->fea_params->nodes_per_element; ++ j)
@@ -263,6 +403,8 @@ static void traverse_function(sexp_item* item, void* data)
     process_line_search(item,parse);
   else if (sexp_item_starts_with_symbol(item,"arc-length"))
     process_arc_length(item,parse);
+  else if (sexp_item_starts_with_symbol(item,"bfgs"))
+    process_bfgs(item,parse);
   else if (sexp_item_starts_with_symbol(item,"nodes"))
     process_nodes(item,parse);
   else if (sexp_item_starts_with_symbol(item,"elements"))
@@ -325,3 +467,484 @@ BOOL sexp_data_load(char *filename,
 
   return result;
 }
+
+
+/*************************************************************/
+/* Streaming loader                                          */
+
+/* token read by the streaming loader */
+typedef enum {
+  SEXP_TOKEN_OPEN,              /* ( */
+  SEXP_TOKEN_CLOSE,             /* ) */
+  SEXP_TOKEN_ATOM,              /* symbol, number or string */
+  SEXP_TOKEN_END,               /* end of file */
+  SEXP_TOKEN_ERROR              /* too long atom */
+} sexp_token_type;
+
+/* Input stream of the streaming loader */
+typedef struct {
+  FILE* file;
+  char buffer[SEXP_STREAM_BUFFER_SIZE];
+  int size;                     /* number of chars in the buffer */
+  int pos;                      /* position of the next char */
+  int line;                     /* current line for error messages */
+  char atom[SEXP_STREAM_ATOM_SIZE]; /* text of the last atom */
+  BOOL capturing;               /* append read chars to the capture */
+  char* capture;                /* text of the settings form being read */
+  int capture_size;
+  int capture_capacity;
+} sexp_stream;
+
+/* forms handled by traverse_function, except the bulk ones */
+static const char* sexp_stream_settings_forms[] = {
+  "model", "model-parameters", "solution", "slae-solver", "element-type",
+  "line-search", "arc-length", "bfgs"
+};
+
+static void sexp_stream_capture(sexp_stream* s, const char* text, int size)
+{
+  if (s->capture_size + size + 1 > s->capture_capacity)
+  {
+    s->capture_capacity = 2*(s->capture_size + size + 1);
+    s->capture = (char*)realloc(s->capture,s->capture_capacity);
+  }
+  memcpy(s->capture + s->capture_size,text,size);
+  s->capture_size += size;
+  s->capture[s->capture_size] = '\0';
+}
+
+static int sexp_stream_peek(sexp_stream* s)
+{
+  if (s->pos == s->size)
+  {
+    s->size = (int)fread(s->buffer,1,SEXP_STREAM_BUFFER_SIZE,s->file);
+    s->pos = 0;
+    if (!s->size)
+      return EOF;
+  }
+  return (unsigned char)s->buffer[s->pos];
+}
+
+static int sexp_stream_getc(sexp_stream* s)
+{
+  int c = sexp_stream_peek(s);
+  if (c != EOF)
+  {
+    if (s->capturing)
+      sexp_stream_capture(s,s->buffer + s->pos,1);
+    s->pos ++;
+    if (c == '\n')
+      s->line ++;
+  }
+  return c;
+}
+
+static sexp_token_type sexp_stream_next(sexp_stream* s)
+{
+  int c, size = 0;
+  /* skip spaces and comments */
+  for (;;)
+  {
+    c = sexp_stream_peek(s);
+    if (c == ';')
+      while ((c = sexp_stream_peek(s)) != EOF && c != '\n')
+        sexp_stream_getc(s);
+    else if (c != EOF && isspace(c))
+      sexp_stream_getc(s);
+    else
+      break;
+  }
+  switch (c)
+  {
+  case EOF:
+    return SEXP_TOKEN_END;
+  case '(':
+    sexp_stream_getc(s);
+    return SEXP_TOKEN_OPEN;
+  case ')':
+    sexp_stream_getc(s);
+    return SEXP_TOKEN_CLOSE;
+  case '"':
+    sexp_stream_getc(s);
+    while ((c = sexp_stream_getc(s)) != EOF && c != '"')
+    {
+      if (c == '\\' && (c = sexp_stream_getc(s)) == EOF)
+        break;
+      if (size == SEXP_STREAM_ATOM_SIZE - 1)
+        return SEXP_TOKEN_ERROR;
+      s->atom[size++] = (char)c;
+    }
+    break;
+  default:
+    while ((c = sexp_stream_peek(s)) != EOF && !isspace(c) &&
+           c != '(' && c != ')' && c != ';' && c != '"')
+    {
+      if (size == SEXP_STREAM_ATOM_SIZE - 1)
+        return SEXP_TOKEN_ERROR;
+      s->atom[size++] = (char)sexp_stream_getc(s);
+    }
+    break;
+  }
+  s->atom[size] = '\0';
+  return SEXP_TOKEN_ATOM;
+}
+
+static BOOL sexp_stream_error(sexp_stream* s, const char* msg)
+{
+  printf("Error: %s at line %d\n",msg,s->line);
+  return FALSE;
+}
+
+/* case-insensitive comparison of the last atom with the symbol */
+static BOOL sexp_stream_atom_is(sexp_stream* s, const char* symbol)
+{
+  const char* atom = s->atom;
+  for (; *atom && *symbol; ++ atom, ++ symbol)
+    if (tolower((unsigned char)*atom) != tolower((unsigned char)*symbol))
+      return FALSE;
+  return !*atom && !*symbol;
+}
+
+static BOOL sexp_stream_real(sexp_stream* s, real* value)
+{
+  char* end;
+  if (sexp_stream_next(s) != SEXP_TOKEN_ATOM)
+    return sexp_stream_error(s,"number expected");
+  *value = strtod(s->atom,&end);
+  if (end == s->atom || *end)
+    return sexp_stream_error(s,"number expected");
+  return TRUE;
+}
+
+static BOOL sexp_stream_int(sexp_stream* s, int* value)
+{
+  char* end;
+  if (sexp_stream_next(s) != SEXP_TOKEN_ATOM)
+    return sexp_stream_error(s,"integer expected");
+  *value = (int)strtol(s->atom,&end,10);
+  if (end == s->atom || *end)
+    return sexp_stream_error(s,"integer expected");
+  return TRUE;
+}
+
+/* new capacity of the full growing array */
+static int sexp_stream_grow(int capacity)
+{
+  return capacity ? 2*capacity : SEXP_STREAM_INITIAL_CAPACITY;
+}
+
+/* skip the value of an attribute, an atom or a whole list */
+static BOOL sexp_stream_skip_value(sexp_stream* s)
+{
+  int depth = 0;
+  do
+  {
+    switch (sexp_stream_next(s))
+    {
+    case SEXP_TOKEN_OPEN:
+      depth ++;
+      break;
+    case SEXP_TOKEN_CLOSE:
+      if (!depth)
+        return sexp_stream_error(s,"attribute value expected");
+      depth --;
+      break;
+    case SEXP_TOKEN_ATOM:
+      break;
+    case SEXP_TOKEN_END:
+    case SEXP_TOKEN_ERROR:
+    default:
+      return sexp_stream_error(s,"unterminated form");
+    }
+  } while (depth);
+  return TRUE;
+}
+
+/*
+ * Settings forms are short: the text of the form is captured and
+ * processed by the same functions as in the tree loader
+ */
+static BOOL sexp_stream_settings(sexp_stream* s, parse_data* data)
+{
+  int depth = 1;
+  FILE* f;
+  sexp_item* item;
+  sexp_token_type token;
+
+  s->capture_size = 0;
+  sexp_stream_capture(s,"(",1);
+  sexp_stream_capture(s,s->atom,(int)strlen(s->atom));
+  s->capturing = TRUE;
+  while (depth)
+  {
+    token = sexp_stream_next(s);
+    if (token == SEXP_TOKEN_OPEN)
+      depth ++;
+    else if (token == SEXP_TOKEN_CLOSE)
+      depth --;
+    else if (token != SEXP_TOKEN_ATOM)
+    {
+      s->capturing = FALSE;
+      return sexp_stream_error(s,"unterminated form");
+    }
+  }
+  s->capturing = FALSE;
+  if (!(f = fmemopen(s->capture,s->capture_size,"r")))
+    return sexp_stream_error(s,"unable to read the form");
+  item = sexp_parse_file(f);
+  fclose(f);
+  if (!item)
+    return sexp_stream_error(s,"unable to parse the form");
+  sexp_item_traverse(item,traverse_function,data);
+  sexp_item_free(item);
+  return TRUE;
+}
+
+/* (nodes (x y z) ...), the head is already read */
+static BOOL sexp_stream_nodes(sexp_stream* s, parse_data* data)
+{
+  int i, capacity = 0;
+  nodes_array* nodes = data->nodes;
+  sexp_token_type token;
+
+  free(nodes->nodes);
+  nodes->nodes = (real(*)[MAX_DOF])0;
+  nodes->nodes_count = 0;
+  while ((token = sexp_stream_next(s)) == SEXP_TOKEN_OPEN)
+  {
+    if (nodes->nodes_count == capacity)
+    {
+      capacity = sexp_stream_grow(capacity);
+      nodes->nodes = (real(*)[MAX_DOF])
+        realloc(nodes->nodes,capacity*MAX_DOF*sizeof(real));
+    }
+    for (i = 0; i < MAX_DOF; ++ i)
+      if (!sexp_stream_real(s,&nodes->nodes[nodes->nodes_count][i]))
+        return FALSE;
+    if (sexp_stream_next(s) != SEXP_TOKEN_CLOSE)
+      return sexp_stream_error(s,"node shall have 3 coordinates");
+    nodes->nodes_count ++;
+  }
+  if (token != SEXP_TOKEN_CLOSE)
+    return sexp_stream_error(s,"node expected");
+  /* release the unused tail of the storage */
+  if (nodes->nodes_count && nodes->nodes_count < capacity)
+    nodes->nodes = (real(*)[MAX_DOF])
+      realloc(nodes->nodes,nodes->nodes_count*MAX_DOF*sizeof(real));
+  return TRUE;
+}
+
+/* (elements (n1 n2 ...) ...), the head is already read */
+static BOOL sexp_stream_elements(sexp_stream* s, parse_data* data)
+{
+  int i, capacity = 0;
+  int nodes_per_element = data->fea_params->nodes_per_element;
+  elements_array* elements = data->elements;
+  sexp_token_type token;
+
+  if (nodes_per_element > MAX_NODES_PER_ELEMENT)
+    return sexp_stream_error(s,"too many nodes per element");
+  free(elements->elements);
+  elements->elements = (int(*)[MAX_NODES_PER_ELEMENT])0;
+  elements->elements_count = 0;
+  while ((token = sexp_stream_next(s)) == SEXP_TOKEN_OPEN)
+  {
+    if (elements->elements_count == capacity)
+    {
+      capacity = sexp_stream_grow(capacity);
+      elements->elements = (int(*)[MAX_NODES_PER_ELEMENT])
+        realloc(elements->elements,
+                capacity*MAX_NODES_PER_ELEMENT*sizeof(int));
+    }
+    for (i = 0; i < nodes_per_element; ++ i)
+      if (!sexp_stream_int(s,
+                           &elements->elements[elements->elements_count][i]))
+        return FALSE;
+    if (sexp_stream_next(s) != SEXP_TOKEN_CLOSE)
+      return sexp_stream_error(s,"wrong number of nodes in element");
+    elements->elements_count ++;
+  }
+  if (token != SEXP_TOKEN_CLOSE)
+    return sexp_stream_error(s,"element expected");
+  if (elements->elements_count && elements->elements_count < capacity)
+    elements->elements = (int(*)[MAX_NODES_PER_ELEMENT])
+      realloc(elements->elements,
+              elements->elements_count*MAX_NODES_PER_ELEMENT*sizeof(int));
+  return TRUE;
+}
+
+/*
+ * (prescribed-displacements (presc-node :node-id n :x x :y y :z z :type t)
+ * ...), the head is already read
+ */
+static BOOL sexp_stream_prescribed(sexp_stream* s, parse_data* data)
+{
+  int capacity = 0;
+  presc_bnd_array* presc = data->presc_boundary;
+  prescribed_bnd_node* node;
+  sexp_token_type token;
+  BOOL result = TRUE;
+  int type;
+
+  free(presc->prescribed_nodes);
+  presc->prescribed_nodes = (prescribed_bnd_node*)0;
+  presc->prescribed_nodes_count = 0;
+  while ((token = sexp_stream_next(s)) == SEXP_TOKEN_OPEN)
+  {
+    if (presc->prescribed_nodes_count == capacity)
+    {
+      capacity = sexp_stream_grow(capacity);
+      presc->prescribed_nodes = (prescribed_bnd_node*)
+        realloc(presc->prescribed_nodes,
+                capacity*sizeof(prescribed_bnd_node));
+    }
+    node = &presc->prescribed_nodes[presc->prescribed_nodes_count];
+    memset(node,0,sizeof(prescribed_bnd_node));
+    if (sexp_stream_next(s) != SEXP_TOKEN_ATOM ||
+        !sexp_stream_atom_is(s,"presc-node"))
+      return sexp_stream_error(s,"presc-node expected");
+    /* attributes in any order */
+    while (result && (token = sexp_stream_next(s)) == SEXP_TOKEN_ATOM)
+    {
+      if (sexp_stream_atom_is(s,":node-id"))
+        result = sexp_stream_int(s,&node->node_number);
+      else if (sexp_stream_atom_is(s,":x"))
+        result = sexp_stream_real(s,&node->values[0]);
+      else if (sexp_stream_atom_is(s,":y"))
+        result = sexp_stream_real(s,&node->values[1]);
+      else if (sexp_stream_atom_is(s,":z"))
+        result = sexp_stream_real(s,&node->values[2]);
+      else if (sexp_stream_atom_is(s,":type"))
+      {
+        result = sexp_stream_int(s,&type);
+        node->type = (presc_boundary_type)type;
+      }
+      else
+        /* ignored as in the tree loader */
+        result = sexp_stream_skip_value(s);
+    }
+    if (!result)
+      return FALSE;
+    if (token != SEXP_TOKEN_CLOSE)
+      return sexp_stream_error(s,"presc-node attribute expected");
+    presc->prescribed_nodes_count ++;
+  }
+  if (token != SEXP_TOKEN_CLOSE)
+    return sexp_stream_error(s,"presc-node expected");
+  if (presc->prescribed_nodes_count &&
+      presc->prescribed_nodes_count < capacity)
+    presc->prescribed_nodes = (prescribed_bnd_node*)
+      realloc(presc->prescribed_nodes,
+              presc->prescribed_nodes_count*sizeof(prescribed_bnd_node));
+  return TRUE;
+}
+
+static BOOL sexp_stream_form(sexp_stream* s, parse_data* data);
+
+/* the rest of the form starting with the token, up to its end */
+static BOOL sexp_stream_list(sexp_stream* s, parse_data* data,
+                             sexp_token_type token)
+{
+  for (; token != SEXP_TOKEN_CLOSE; token = sexp_stream_next(s))
+  {
+    if (token == SEXP_TOKEN_OPEN)
+    {
+      if (!sexp_stream_form(s,data))
+        return FALSE;
+    }
+    else if (token == SEXP_TOKEN_ERROR)
+      return sexp_stream_error(s,"too long atom");
+    else if (token != SEXP_TOKEN_ATOM)
+      return sexp_stream_error(s,"unterminated form");
+  }
+  return TRUE;
+}
+
+/* the form, the opening parenthesis is already read */
+static BOOL sexp_stream_form(sexp_stream* s, parse_data* data)
+{
+  int i;
+  sexp_token_type token = sexp_stream_next(s);
+  if (token == SEXP_TOKEN_ATOM)
+  {
+    if (sexp_stream_atom_is(s,"nodes"))
+      return sexp_stream_nodes(s,data);
+    if (sexp_stream_atom_is(s,"elements"))
+      return sexp_stream_elements(s,data);
+    if (sexp_stream_atom_is(s,"prescribed-displacements"))
+      return sexp_stream_prescribed(s,data);
+    for (i = 0; i < (int)(sizeof(sexp_stream_settings_forms)/
+                          sizeof(sexp_stream_settings_forms[0])); ++ i)
+      if (sexp_stream_atom_is(s,sexp_stream_settings_forms[i]))
+        return sexp_stream_settings(s,data);
+    token = sexp_stream_next(s);
+  }
+  /* other forms may contain the ones above */
+  return sexp_stream_list(s,data,token);
+}
+
+
+BOOL sexp_stream_data_load(char *filename,
+                           fea_task **task,
+                           fea_solution_params **fea_params,
+                           nodes_array **nodes,
+                           elements_array **elements,
+                           presc_bnd_array **presc_boundary)
+{
+  BOOL result = FALSE;
+  sexp_stream* s;
+  parse_data parse;
+
+  s = (sexp_stream*)malloc(sizeof(sexp_stream));
+  /* Try to open file */
+  if (!(s->file = fopen(filename,"rt")))
+  {
+    fprintf(stderr,"Error, could not open file %s\n",filename);
+    free(s);
+    return FALSE;
+  }
+  s->size = 0;
+  s->pos = 0;
+  s->line = 1;
+  s->capturing = FALSE;
+  s->capture = (char*)0;
+  s->capture_size = 0;
+  s->capture_capacity = 0;
+
+  /* allocate parse data */
+  parse.task = fea_task_alloc();
+  parse.fea_params = fea_solution_params_alloc();
+  parse.nodes = nodes_array_alloc();
+  parse.elements = elements_array_alloc();
+  parse.presc_boundary = presc_bnd_array_alloc();
+  parse.current_size = 0;
+  parse.current_text = (char*)0;
+
+  if (sexp_stream_next(s) == SEXP_TOKEN_OPEN &&
+      sexp_stream_next(s) == SEXP_TOKEN_ATOM &&
+      sexp_stream_atom_is(s,"task"))
+    result = sexp_stream_list(s,&parse,sexp_stream_next(s));
+  else
+    printf("Error: unable to parse SEXP input\n");
+
+  if (result)
+  {
+    *task = parse.task;
+    *fea_params = parse.fea_params;
+    *nodes = parse.nodes;
+    *elements = parse.elements;
+    *presc_boundary = parse.presc_boundary;
+  }
+  else
+  {
+    fea_task_free(parse.task);
+    fea_solution_params_free(parse.fea_params);
+    nodes_array_free(parse.nodes);
+    elements_array_free(parse.elements);
+    presc_bnd_array_free(parse.presc_boundary);
+  }
+  fclose(s->file);
+  free(s->capture);
+  free(s);
+  return result;
+}
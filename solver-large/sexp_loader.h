@@ -3,6 +3,13 @@
 #include "defines.h"
 #include "fea_solver.h"
 
+/* size of the read buffer of the streaming loader */
+#define SEXP_STREAM_BUFFER_SIZE 65536
+/* maximum length of an atom read by the streaming loader */
+#define SEXP_STREAM_ATOM_SIZE 256
+/* initial capacity of arrays growing while loading */
+#define SEXP_STREAM_INITIAL_CAPACITY 1024
+
 /* loader for the data from the .sexp file */
 BOOL sexp_data_load(char *filename,
                     fea_task **task,
@@ -10,3 +17,16 @@ BOOL sexp_data_load(char *filename,
                     nodes_array **nodes,
                     elements_array **elements,
                     presc_bnd_array **presc_boundary);
+
+/*
+ * single-pass loader for the data from the .sexp file.
+ * Nodes, elements and prescribed boundary conditions are read
+ * token by token straight into the arrays, no tree of the document
+ * is built
+ */
+BOOL sexp_stream_data_load(char *filename,
+                           fea_task **task,
+                           fea_solution_params **fea_params,
+                           nodes_array **nodes,
+                           elements_array **elements,
+                           presc_bnd_array **presc_boundary);
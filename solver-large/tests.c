@@ -1,13 +1,25 @@
 /* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
 
+/* mkstemp */
+#define _POSIX_C_SOURCE 200809L
+
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <memory.h>
+#include <unistd.h>
 
 #include "defines.h"
 #include "tests.h"
 #include "dense_matrix.h"
+#include "fea_model.h"
+#include "ordering.h"
+#include "pcg.h"
+#include "amg.h"
+#include "bsr_matrix.h"
+#include "binary_loader.h"
+#include "sexp_loader.h"
 
 static BOOL test_dense_matrix()
 {
@@ -50,7 +62,494 @@ static BOOL test_dense_matrix()
   return result;
 }
 
+/*
+ * Compare C tensor in Voigt notation with the C tensor
+ * symmetrized by the 1st and 2nd pairs of indexes
+ */
+static BOOL test_model_ctensor_voigt(model_type type)
+{
+  BOOL result = TRUE;
+  int I,J,i,j,k,l;
+  /* mapping of Voigt indexes to tensor indexes */
+  int voigt[VOIGT_SIZE][2] = {{0, 0}, {1, 1}, {2, 2}, {0, 1}, {1, 2}, {0, 2}};
+  /* deformation gradient */
+  real F[3][3] = {{1.1, 0.2, 0.05}, {0.1, 0.95, 0.0}, {-0.05, 0.1, 1.2}};
+  real ctens[3][3][3][3];
+  real D[VOIGT_SIZE][VOIGT_SIZE];
+  real cijkl;
+  fea_model model;
+  model.parameters[0] = 100;
+  model.parameters[1] = 50;
+  fea_model_init(&model,type);
+
+  model.ctensor(&model,F,ctens);
+  model.ctensor_voigt(&model,F,D);
+  for (I = 0; I < VOIGT_SIZE; ++ I)
+    for (J = 0; J < VOIGT_SIZE; ++ J)
+    {
+      i = voigt[I][0]; j = voigt[I][1];
+      k = voigt[J][0]; l = voigt[J][1];
+      cijkl = (ctens[i][j][k][l] + ctens[i][j][l][k] +
+               ctens[j][i][k][l] + ctens[j][i][l][k])/4.;
+      result &= fabs(D[I][J] - cijkl) <= 1e-12*fabs(cijkl) + 1e-12;
+      result &= EQUAL(D[I][J],D[J][I]);
+    }
+  printf("test_model_ctensor_voigt(%d) result: *%s*\n",type,
+         result ? "pass" : "fail");
+  return result;
+}
+
+/* check what perm is a permutation of 0..n-1 */
+static BOOL test_is_permutation(int n, int* perm)
+{
+  BOOL result = TRUE;
+  int i;
+  int* count = (int*)calloc(n,sizeof(int));
+  for (i = 0; i < n && result; ++ i)
+  {
+    result = perm[i] >= 0 && perm[i] < n && !count[perm[i]];
+    if (result)
+      count[perm[i]] ++;
+  }
+  free(count);
+  return result;
+}
+
+/*
+ * Fill-reducing orderings of the graph of the regular grid
+ * size x size x size with 6 neighbors per vertex
+ */
+static BOOL test_ordering()
+{
+  BOOL result = TRUE;
+  const int size = 12;
+  int n = size*size*size;
+  int* xadj = (int*)malloc(sizeof(int)*(n+1));
+  int* adj = (int*)malloc(sizeof(int)*6*n);
+  int* perm = (int*)malloc(sizeof(int)*n);
+  real (*coords)[MAX_DOF] = (real(*)[MAX_DOF])malloc(sizeof(real)*MAX_DOF*n);
+  int i,j,k,v,count = 0;
+  for (i = 0; i < size; ++ i)
+    for (j = 0; j < size; ++ j)
+      for (k = 0; k < size; ++ k)
+      {
+        v = (i*size + j)*size + k;
+        xadj[v] = count;
+        coords[v][0] = i; coords[v][1] = j; coords[v][2] = k;
+        if (i > 0) adj[count++] = v - size*size;
+        if (i < size-1) adj[count++] = v + size*size;
+        if (j > 0) adj[count++] = v - size;
+        if (j < size-1) adj[count++] = v + size;
+        if (k > 0) adj[count++] = v - 1;
+        if (k < size-1) adj[count++] = v + 1;
+      }
+  xadj[n] = count;
+  
+  ordering_minimum_degree(n,xadj,adj,perm);
+  /* corner vertex 0 has the smallest degree and index */
+  result = test_is_permutation(n,perm) && perm[0] == 0;
+  if (result)
+  {
+    ordering_nested_dissection(n,xadj,adj,coords,perm);
+    result = test_is_permutation(n,perm);
+  }
+  free(coords);
+  free(perm);
+  free(adj);
+  free(xadj);
+  printf("test_ordering result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_bsr_matrix()
+{
+  BOOL result = TRUE;
+  /* chain of 4 nodes */
+  int xadj[] = {0,1,3,5,6};
+  int adj[] = {1, 0,2, 1,3, 2};
+  int n = 4*BSR_BLOCK_SIZE;
+  bsr_matrix mtx;
+  int* offsets;
+  int* indexes;
+  real* values;
+  real x[4*BSR_BLOCK_SIZE],y[4*BSR_BLOCK_SIZE],sum;
+  int i,j;
+
+  bsr_matrix_init(&mtx,4,xadj,adj);
+  /* diagonal block first in the input, sorted in the matrix */
+  result = mtx.offsets[4] == 10 && mtx.indexes[1] == 1 && mtx.indexes[2] == 0;
+  result = result && mtx.indexes[3] == 1 && mtx.indexes[4] == 2;
+  for (i = 0; i < n; ++ i)
+  {
+    x[i] = i + 1;
+    for (j = 0; j < n; ++ j)
+      if (bsr_matrix_element(&mtx,i,j))
+        *bsr_matrix_element(&mtx,i,j) = (real)(i*n + j)/n;
+  }
+  result = result && !bsr_matrix_element(&mtx,0,n-1);
+  /* compare with the scalar product */
+  bsr_matrix_mv(&mtx,x,y);
+  bsr_matrix_csr(&mtx,&offsets,&indexes,&values);
+  for (i = 0; i < n && result; ++ i)
+  {
+    sum = 0;
+    for (j = offsets[i]; j < offsets[i+1]; ++ j)
+      sum += values[j]*x[indexes[j]];
+    result = fabs(sum - y[i]) <= 1e-12*fabs(sum);
+  }
+  free(values);
+  free(indexes);
+  free(offsets);
+  bsr_matrix_free(&mtx);
+  printf("test_bsr_matrix result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static void test_amg_operator(void* data, real* x, real* y)
+{
+  amg_matrix_mv((amg_matrix_ptr)data,x,y);
+}
+
+static BOOL test_amg()
+{
+  BOOL result = TRUE;
+  const int size = 10;
+  int nodes_count = size*size*size;
+  int n = MAX_DOF*nodes_count;
+  amg_matrix A;
+  amg_params params;
+  amg_hierarchy_ptr amg;
+  int* node_offsets = (int*)malloc(sizeof(int)*(nodes_count+1));
+  int* components = (int*)malloc(sizeof(int)*n);
+  real (*coords)[MAX_DOF] =
+    (real(*)[MAX_DOF])malloc(sizeof(real)*MAX_DOF*nodes_count);
+  real* b = (real*)malloc(sizeof(real)*n);
+  real* x = (real*)calloc(n,sizeof(real));
+  real tolerance = 1e-10;
+  int i,j,k,d,v,row,iter,count = 0;
+
+  /* 7-point Laplacian with Dirichlet boundary for every component */
+  A.rows_count = A.cols_count = n;
+  A.offsets = (int*)malloc(sizeof(int)*(n+1));
+  A.indexes = (int*)malloc(sizeof(int)*7*n);
+  A.values = (real*)malloc(sizeof(real)*7*n);
+  for (i = 0; i < size; ++ i)
+    for (j = 0; j < size; ++ j)
+      for (k = 0; k < size; ++ k)
+      {
+        v = (i*size + j)*size + k;
+        node_offsets[v] = v*MAX_DOF;
+        coords[v][0] = i; coords[v][1] = j; coords[v][2] = k;
+        for (d = 0; d < MAX_DOF; ++ d)
+        {
+          row = v*MAX_DOF + d;
+          components[row] = d;
+          b[row] = 1;
+          A.offsets[row] = count;
+          if (i > 0)
+          {
+            A.indexes[count] = row - MAX_DOF*size*size;
+            A.values[count++] = -1;
+          }
+          if (j > 0)
+          {
+            A.indexes[count] = row - MAX_DOF*size;
+            A.values[count++] = -1;
+          }
+          if (k > 0)
+          {
+            A.indexes[count] = row - MAX_DOF;
+            A.values[count++] = -1;
+          }
+          A.indexes[count] = row;
+          A.values[count++] = 6;
+          if (k < size-1)
+          {
+            A.indexes[count] = row + MAX_DOF;
+            A.values[count++] = -1;
+          }
+          if (j < size-1)
+          {
+            A.indexes[count] = row + MAX_DOF*size;
+            A.values[count++] = -1;
+          }
+          if (i < size-1)
+          {
+            A.indexes[count] = row + MAX_DOF*size*size;
+            A.values[count++] = -1;
+          }
+        }
+      }
+  A.offsets[n] = count;
+  node_offsets[nodes_count] = n;
+
+  params.strength = AMG_STRENGTH;
+  params.coarse_size = 100;
+  params.max_levels = AMG_MAX_LEVELS;
+  params.smooth_steps = AMG_SMOOTH_STEPS;
+  params.prolongator_omega = AMG_PROLONGATOR_OMEGA;
+  amg = amg_alloc(&params,n,A.offsets,A.indexes,A.values,
+                  nodes_count,node_offsets,components,coords);
+  iter = pcg_solve(n,test_amg_operator,&A,amg_cycle,amg,b,x,
+                   n,&tolerance);
+  /* the multigrid shall coarsen and converge in a few iterations */
+  result = amg->levels_count > 1 && tolerance <= 1e-10 && iter < 50;
+  
+  amg_free(amg);
+  free(A.values);
+  free(A.indexes);
+  free(A.offsets);
+  free(x);
+  free(b);
+  free(coords);
+  free(components);
+  free(node_offsets);
+  printf("test_amg result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+/*
+ * create an empty temporary file in $TMPDIR or, if it is not set or
+ * not writable, in /tmp. Returns FALSE if neither is usable
+ */
+static BOOL test_temp_file(char* name, int size)
+{
+  const char* dirs[2];
+  int i,fd;
+  dirs[0] = getenv("TMPDIR");
+  dirs[1] = "/tmp";
+  for (i = 0; i < 2; ++ i)
+  {
+    if (!dirs[i] || !*dirs[i] ||
+        snprintf(name,size,"%s/fea_testXXXXXX",dirs[i]) >= size)
+      continue;
+    if ((fd = mkstemp(name)) >= 0)
+    {
+      close(fd);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static BOOL test_binary_task(const char* filename)
+{
+  BOOL result;
+  fea_task_ptr task = fea_task_alloc();
+  fea_solution_params_ptr fea_params = fea_solution_params_alloc();
+  nodes_array_ptr nodes = nodes_array_alloc();
+  elements_array_ptr elements = elements_array_alloc();
+  presc_bnd_array_ptr presc = presc_bnd_array_alloc();
+  fea_task_ptr task1 = (fea_task_ptr)0;
+  fea_solution_params_ptr fea_params1 = (fea_solution_params_ptr)0;
+  nodes_array_ptr nodes1 = (nodes_array_ptr)0;
+  elements_array_ptr elements1 = (elements_array_ptr)0;
+  presc_bnd_array_ptr presc1 = (presc_bnd_array_ptr)0;
+  int i,j;
+
+  task->load_increments_count = 7;
+  task->model.parameters[1] = 0.25;
+  fea_params->gauss_nodes_count = 4;
+  nodes->nodes_count = 5;
+  nodes->nodes = (real(*)[MAX_DOF])malloc(sizeof(real)*MAX_DOF*5);
+  for (i = 0; i < nodes->nodes_count; ++ i)
+    for (j = 0; j < MAX_DOF; ++ j)
+      nodes->nodes[i][j] = i + j/3.0;
+  elements->elements_count = 2;
+  elements->elements = (int(*)[MAX_NODES_PER_ELEMENT])
+    malloc(sizeof(int)*MAX_NODES_PER_ELEMENT*2);
+  for (i = 0; i < elements->elements_count; ++ i)
+    for (j = 0; j < MAX_NODES_PER_ELEMENT; ++ j)
+      elements->elements[i][j] = (i + j) % nodes->nodes_count;
+  presc->prescribed_nodes_count = 1;
+  presc->prescribed_nodes = (prescribed_bnd_node*)
+    calloc(1,sizeof(prescribed_bnd_node));
+  presc->prescribed_nodes[0].node_number = 3;
+  presc->prescribed_nodes[0].values[2] = -0.5;
+  presc->prescribed_nodes[0].type = PRESCRIBEDXZ;
+
+  result =
+    binary_data_save((char*)filename,task,fea_params,nodes,elements,presc) &&
+    binary_data_load((char*)filename,&task1,&fea_params1,&nodes1,&elements1,
+                     &presc1);
+  /* arrays are read from the mapping */
+  result = result && task1->mapped_data && nodes1->mapped &&
+    elements1->mapped && presc1->mapped;
+  result = result && task1->load_increments_count == 7 &&
+    task1->model.parameters[1] == 0.25 && !task1->export_file &&
+    fea_params1->gauss_nodes_count == 4 &&
+    fea_params1->nodes_per_element == fea_params->nodes_per_element;
+  result = result && nodes1->nodes_count == nodes->nodes_count &&
+    !memcmp(nodes1->nodes,nodes->nodes,
+            sizeof(real)*MAX_DOF*nodes->nodes_count);
+  result = result && elements1->elements_count == elements->elements_count &&
+    !memcmp(elements1->elements,elements->elements,
+            sizeof(int)*MAX_NODES_PER_ELEMENT*elements->elements_count);
+  result = result && presc1->prescribed_nodes_count == 1 &&
+    presc1->prescribed_nodes[0].node_number == 3 &&
+    presc1->prescribed_nodes[0].values[0] == 0 &&
+    presc1->prescribed_nodes[0].values[2] == -0.5 &&
+    presc1->prescribed_nodes[0].type == PRESCRIBEDXZ;
+
+  /* mapped arrays are released with the task */
+  if (task1)
+  {
+    presc_bnd_array_free(presc1);
+    elements_array_free(elements1);
+    nodes_array_free(nodes1);
+    fea_solution_params_free(fea_params1);
+    fea_task_free(task1);
+  }
+  presc_bnd_array_free(presc);
+  elements_array_free(elements);
+  nodes_array_free(nodes);
+  fea_solution_params_free(fea_params);
+  fea_task_free(task);
+  printf("test_binary_task result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+/*
+ * task for the comparison of the tree and streaming .sexp loaders:
+ * comments, strings with escapes, attributes in any order, unknown
+ * attributes with list values, the label atom of the maximum length
+ */
+static const char* test_sexp_head =
+  ";; comment with (parens) and \"quotes\n"
+  "(task\n"
+  " (model :name COMPRESSIBLE_NEOHOOKEAN\n"
+  "        (model-parameters :mu 80.5 :lambda 120)) ; trailing comment\n"
+  " (solution :desired-tolerance 1e-7 :task-type CARTESIAN3D\n"
+  "           :load-increments-count 3 :modified-newton no\n"
+  "           :max-newton-count 15\n"
+  "   (element-type :gauss-nodes-count 5 :name TETRAHEDRA10"
+  " :nodes-count 10)\n"
+  "   (slae-solver :type PCG_ILU :tolerance 1e-9)\n"
+  "   (line-search :max 2))\n"
+  " (description \"a \\\"quoted\\\" string ; with (parens)\")\n"
+  " (label ";
+static const char* test_sexp_tail =
+  ")\n"
+  " (input-data\n"
+  "  (geometry\n"
+  "   (nodes\n"
+  "    (0.0 0.0 0.0) (1.5 0 0)\n"
+  "    (0 2.25 0) ; comment between nodes\n"
+  "    (0 0 -3e-1))\n"
+  "   (elements\n"
+  "    (1 2 3 4 5 6 7 8 9 10)\n"
+  "    (4 3 2 1 10 9 8 7 6 5)))\n"
+  "  (boundary-conditions\n"
+  "   (prescribed-displacements\n"
+  "    (presc-node :node-id 1 :x 0 :y 0 :z 0 :type 7)\n"
+  "    (presc-node :type 4 :note (a (b c)) :z 0.25 :node-id 2"
+  " :origin \"mesh\" :y 0 :x 0)))))\n";
+
+static BOOL test_sexp_loaders(const char* filename)
+{
+  BOOL result;
+  char label[SEXP_STREAM_ATOM_SIZE];
+  FILE* f;
+  fea_task_ptr task[2] = {(fea_task_ptr)0,(fea_task_ptr)0};
+  fea_solution_params_ptr fea_params[2];
+  nodes_array_ptr nodes[2];
+  elements_array_ptr elements[2];
+  presc_bnd_array_ptr presc[2];
+  prescribed_bnd_node *p0,*p1;
+  int i;
+
+  memset(label,'a',sizeof(label)-1);
+  label[sizeof(label)-1] = '\0';
+  result = (f = fopen(filename,"w")) != (FILE*)0;
+  if (result)
+  {
+    fprintf(f,"%s%s%s",test_sexp_head,label,test_sexp_tail);
+    fclose(f);
+  }
+  result = result &&
+    sexp_data_load((char*)filename,&task[0],&fea_params[0],&nodes[0],
+                   &elements[0],&presc[0]) &&
+    sexp_stream_data_load((char*)filename,&task[1],&fea_params[1],&nodes[1],
+                          &elements[1],&presc[1]);
+
+  result = result && task[1]->model.model == MODEL_COMPRESSIBLE_NEOHOOKEAN &&
+    task[1]->model.parameters[0] == 120 &&
+    task[1]->model.parameters[1] == 80.5 &&
+    task[1]->solver_type == PCG_ILU && task[1]->solver_tolerance == 1e-9 &&
+    task[1]->linesearch_max == 2 && task[1]->load_increments_count == 3 &&
+    !task[1]->modified_newton;
+  result = result && task[0]->model.model == task[1]->model.model &&
+    task[0]->model.parameters[0] == task[1]->model.parameters[0] &&
+    task[0]->model.parameters[1] == task[1]->model.parameters[1] &&
+    task[0]->solver_type == task[1]->solver_type &&
+    task[0]->solver_tolerance == task[1]->solver_tolerance &&
+    task[0]->desired_tolerance == task[1]->desired_tolerance &&
+    task[0]->max_newton_count == task[1]->max_newton_count &&
+    task[0]->linesearch_max == task[1]->linesearch_max &&
+    task[0]->load_increments_count == task[1]->load_increments_count &&
+    task[0]->modified_newton == task[1]->modified_newton &&
+    !memcmp(fea_params[0],fea_params[1],sizeof(fea_solution_params));
+  result = result && nodes[1]->nodes_count == 4 &&
+    nodes[1]->nodes[3][2] == -0.3 &&
+    nodes[0]->nodes_count == nodes[1]->nodes_count &&
+    !memcmp(nodes[0]->nodes,nodes[1]->nodes,
+            sizeof(real)*MAX_DOF*nodes[0]->nodes_count);
+  result = result && elements[1]->elements_count == 2 &&
+    elements[1]->elements[1][9] == 5 &&
+    elements[0]->elements_count == elements[1]->elements_count &&
+    !memcmp(elements[0]->elements,elements[1]->elements,
+            sizeof(int)*MAX_NODES_PER_ELEMENT*elements[0]->elements_count);
+  result = result && presc[1]->prescribed_nodes_count == 2 &&
+    presc[1]->prescribed_nodes[1].node_number == 2 &&
+    presc[1]->prescribed_nodes[1].values[2] == 0.25 &&
+    presc[0]->prescribed_nodes_count == presc[1]->prescribed_nodes_count;
+  for (i = 0; result && i < presc[0]->prescribed_nodes_count; ++ i)
+  {
+    p0 = &presc[0]->prescribed_nodes[i];
+    p1 = &presc[1]->prescribed_nodes[i];
+    result = p0->node_number == p1->node_number && p0->type == p1->type &&
+      !memcmp(p0->values,p1->values,sizeof(p0->values));
+  }
+
+  for (i = 0; i < 2; ++ i)
+    if (task[i])
+    {
+      presc_bnd_array_free(presc[i]);
+      elements_array_free(elements[i]);
+      nodes_array_free(nodes[i]);
+      fea_solution_params_free(fea_params[i]);
+      fea_task_free(task[i]);
+    }
+  printf("test_sexp_loaders result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+/*
+ * Tests writing files. The solver shall start even without a scratch
+ * directory, so they are skipped if no temporary file can be created
+ */
+static BOOL test_files()
+{
+  BOOL result;
+  char filename[FILENAME_MAX];
+  if (!test_temp_file(filename,sizeof(filename)))
+  {
+    printf("test_files result: *skipped*, no temporary directory\n");
+    return TRUE;
+  }
+  result = test_binary_task(filename) &&
+    test_sexp_loaders(filename);
+  remove(filename);
+  return result;
+}
+
 BOOL do_tests()
 {
-  return test_dense_matrix();
+  return test_dense_matrix() &&
+    test_model_ctensor_voigt(MODEL_A5) &&
+    test_model_ctensor_voigt(MODEL_COMPRESSIBLE_NEOHOOKEAN) &&
+    test_ordering() &&
+    test_bsr_matrix() &&
+    test_amg() &&
+    test_files();
 }